@@ -37,7 +37,8 @@ typedef enum favorites_error{
 	FAVORITES_ERROR_NONE			= TIZEN_ERROR_NONE,              /**< Successful */
 	FAVORITES_ERROR_INVALID_PARAMETER	= TIZEN_ERROR_INVALID_PARAMETER,/**< Invalid parameter */
 	FAVORITES_ERROR_DB_FAILED		= TIZEN_ERROR_WEB_CLASS | 0x62,  /**< Database operation failure */
-	FAVORITES_ERROR_ITEM_ALREADY_EXIST	= TIZEN_ERROR_WEB_CLASS | 0x63 /**< Requested data already exists */
+	FAVORITES_ERROR_ITEM_ALREADY_EXIST	= TIZEN_ERROR_WEB_CLASS | 0x63, /**< Requested data already exists */
+	FAVORITES_ERROR_READ_ONLY		= TIZEN_ERROR_WEB_CLASS | 0x64  /**< Modification refused in read-only mode */
 } favorites_error_e;
 
 /**
@@ -61,6 +62,16 @@ typedef struct {
 	bool editable;	/**< The flag of editability\n @c true : writable, @c false: read-only, not ediable */
 } favorites_bookmark_entry_s;
 
+/**
+ * @brief   Enumerations of the bookmark fields written by favorites_bookmark_update().
+ */
+typedef enum
+{
+	FAVORITES_BOOKMARK_FIELD_TITLE		= 1 << 0,	/**< favorites_bookmark_entry_s::title */
+	FAVORITES_BOOKMARK_FIELD_ADDRESS	= 1 << 1,	/**< favorites_bookmark_entry_s::address, bookmarks only */
+	FAVORITES_BOOKMARK_FIELD_EDITABLE	= 1 << 2	/**< favorites_bookmark_entry_s::editable */
+} favorites_bookmark_field_e;
+
 /**
  * @brief       Called to get bookmark details for each found bookmark.
  *
@@ -94,10 +105,31 @@ typedef bool (*favorites_bookmark_foreach_cb)(favorites_bookmark_entry_s *item,
  */
 int favorites_bookmark_add_bookmark(const char *url, const char *title, const char *folder_name, int *bookmark_id);
 
+/**
+ * @brief       Adds a folder to the bookmark list.
+ *
+ * @details Folders can be nested to any depth.
+ *
+ * @param[in]   title	The title of the folder
+ * @param[in]   parent_id	The unique ID of the parent folder, 1 is the root folder
+ * @param[out]  folder_id	The unique id of the added folder. This can be @c NULL.
+ *
+ * @return  0 on success, otherwise a negative error value.
+ * @retval  #FAVORITES_ERROR_NONE        Successful
+ * @retval  #FAVORITES_ERROR_DB_FAILED   Database failed
+ * @retval  #FAVORITES_ERROR_INVALID_PARAMETER   Invalid parameter
+ * @retval  #FAVORITES_ERROR_ITEM_ALREADY_EXIST	A folder of the same title already exists in the parent folder
+ *
+ */
+int favorites_bookmark_add_folder(const char *title, int parent_id, int *folder_id);
+
 /**
  * @brief       Deletes the bookmark item of given bookmark id.
  *
- * @param[in]   bookmark_id	The unique ID of bookmark to delete
+ * @details Deleting a folder also deletes everything it contains. Deleting an id
+ * which does not exist succeeds and changes nothing.
+ *
+ * @param[in]   bookmark_id	The unique ID of bookmark to delete, the root folder cannot be deleted
  *
  * @return  0 on success, otherwise a negative error value.
  * @retval  #FAVORITES_ERROR_NONE                Successful
@@ -118,6 +150,46 @@ int favorites_bookmark_delete_bookmark(int bookmark_id);
  */
 int favorites_bookmark_delete_all_bookmarks(void);
 
+/**
+ * @brief       Moves a bookmark or a folder to the given position.
+ *
+ * @details The item is placed right before @a before_id in @a folder_id, or at the end of
+ * the folder if @a before_id is 0 or less. Usually only the moved item is rewritten;
+ * when the folder has no room left at that position, a few of the following items are
+ * renumbered as well.
+ *
+ * @remarks  A folder cannot be moved into itself or into one of its sub folders.
+ * @param[in]   bookmark_id	The unique ID of the bookmark or folder to move
+ * @param[in]   folder_id	The unique ID of the destination folder, 1 is the root folder
+ * @param[in]   before_id	The unique ID of the item in @a folder_id to move before, or 0 to append
+ *
+ * @return  0 on success, otherwise a negative error value.
+ * @retval  #FAVORITES_ERROR_NONE                Successful
+ * @retval  #FAVORITES_ERROR_INVALID_PARAMETER   Invalid parameter
+ * @retval  #FAVORITES_ERROR_DB_FAILED           Database failed
+ *
+ */
+int favorites_bookmark_move(int bookmark_id, int folder_id, int before_id);
+
+/**
+ * @brief       Updates fields of a bookmark or a folder in place.
+ *
+ * @details Only the fields in @a field_mask are read from @a values and written, the id,
+ * the creation date and the position are kept. The update date is only set when one of
+ * the fields actually changes.
+ *
+ * @param[in]   bookmark_id	The unique ID of the bookmark or folder to update
+ * @param[in]   field_mask	The fields to write, a bitwise OR of #favorites_bookmark_field_e values
+ * @param[in]   values	The new values of the fields in @a field_mask
+ *
+ * @return  0 on success, otherwise a negative error value.
+ * @retval  #FAVORITES_ERROR_NONE                Successful
+ * @retval  #FAVORITES_ERROR_INVALID_PARAMETER   Invalid parameter
+ * @retval  #FAVORITES_ERROR_DB_FAILED           Database failed
+ *
+ */
+int favorites_bookmark_update(int bookmark_id, int field_mask, const favorites_bookmark_entry_s *values);
+
 /**
  * @brief       Gets a number of bookmark list items.
  *
@@ -131,6 +203,25 @@ int favorites_bookmark_delete_all_bookmarks(void);
  */
 int favorites_bookmark_get_count(int *count);
 
+/**
+ * @brief       Looks up which of the given urls are bookmarked.
+ *
+ * @details The urls are answered by one query per 256 of them, also in read-only mode.
+ * A url must match the address of a bookmark exactly.
+ *
+ * @param[in]   urls	The urls to look up, an entry can be @c NULL
+ * @param[in]   n	The number of urls
+ * @param[out]  out_ids	An array of @a n ids, set to the id of a bookmark of each url, or 0 if the url is not bookmarked
+ *
+ * @return  0 on success, otherwise a negative error value.
+ * @retval  #FAVORITES_ERROR_NONE                Successful
+ * @retval  #FAVORITES_ERROR_INVALID_PARAMETER   Invalid parameter
+ * @retval  #FAVORITES_ERROR_DB_FAILED           Database failed
+ *
+ * @see favorites_url_is_known()
+ */
+int favorites_bookmark_lookup_urls(const char **urls, int n, int *out_ids);
+
 /**
  * @brief       Retrieves all bookmarks and folders by invoking the given callback function iteratively.
  *
@@ -149,6 +240,179 @@ int favorites_bookmark_get_count(int *count);
  */
 int favorites_bookmark_foreach(favorites_bookmark_foreach_cb callback, void *user_data);
 
+/**
+ * @brief       Called to get bookmark details for each item of the folder hierarchy.
+ *
+ * @param[in]   item	The bookmark entry handle or folder entry handle
+ * @param[in]   depth	The nesting level of the item, 0 for items of the root folder
+ * @param[in]   user_data	The user data passed from the foreach function
+ *
+ * @return @c true to continue with the next iteration of the loop or @c false to break out of the loop.
+ *
+ * @pre		favorites_bookmark_foreach_tree() will invoke this callback.
+ *
+ * @see		favorites_bookmark_foreach_tree()
+ */
+typedef bool (*favorites_bookmark_tree_cb)(favorites_bookmark_entry_s *item, int depth, void *user_data);
+
+/**
+ * @brief       Retrieves the whole folder hierarchy depth-first by invoking the given callback function iteratively.
+ *
+ * @details Every folder is followed by its contents, items of a folder come in their order.
+ * The hierarchy is read with a single query.
+ *
+ * @param[in]   callback	The callback function to invoke
+ * @param[in]   user_data	The user data to be passed to the callback function
+ *
+ * @return  0 on success, otherwise a negative error value.
+ * @retval  #FAVORITES_ERROR_NONE                Successful
+ * @retval  #FAVORITES_ERROR_INVALID_PARAMETER   Invalid parameter
+ * @retval  #FAVORITES_ERROR_DB_FAILED           Database failed
+ *
+ * @post	This function invokes favorites_bookmark_tree_cb() repeatedly for each item.
+ *
+ * @see favorites_bookmark_tree_cb()
+ */
+int favorites_bookmark_foreach_tree(favorites_bookmark_tree_cb callback, void *user_data);
+
+/**
+ * @brief   The structure of a folder summary, passed to favorites_bookmark_folder_summary_cb().
+ *
+ * @details The strings belong to the library and are only valid during the callback.
+ */
+typedef struct {
+	char* title;	/**< The title of the folder */
+	char* latest_update_date;	/**< The last updated date of the items in the folder, NULL if it is empty */
+	char* latest_creation_date;	/**< The date of the newest item in the folder, NULL if it is empty */
+	int id;	/**< The unique ID of the folder */
+	int folder_id;	/**< The ID of parent folder, 0 for the root folder */
+	int item_count;	/**< The number of bookmarks and folders directly in the folder */
+} favorites_bookmark_folder_summary_s;
+
+/**
+ * @brief       Called to get the summary of each folder.
+ *
+ * @param[in]   summary	The folder summary
+ * @param[in]   user_data	The user data passed from the foreach function
+ *
+ * @return @c true to continue with the next iteration of the loop or @c false to break out of the loop.
+ *
+ * @pre		favorites_bookmark_foreach_folder_summary() will invoke this callback.
+ *
+ * @see		favorites_bookmark_foreach_folder_summary()
+ */
+typedef bool (*favorites_bookmark_folder_summary_cb)(favorites_bookmark_folder_summary_s *summary, void *user_data);
+
+/**
+ * @brief       Retrieves every folder with the number and dates of its items by invoking the given callback function iteratively.
+ *
+ * @details The root folder comes first, then the others in their order. The summaries
+ * are read with a single grouped query, whatever the number of folders.
+ *
+ * @param[in]   callback	The callback function to invoke
+ * @param[in]   user_data	The user data to be passed to the callback function
+ *
+ * @return  0 on success, otherwise a negative error value.
+ * @retval  #FAVORITES_ERROR_NONE                Successful
+ * @retval  #FAVORITES_ERROR_INVALID_PARAMETER   Invalid parameter
+ * @retval  #FAVORITES_ERROR_DB_FAILED           Database failed
+ *
+ * @post	This function invokes favorites_bookmark_folder_summary_cb() repeatedly for each folder.
+ *
+ * @see favorites_bookmark_folder_summary_cb()
+ */
+int favorites_bookmark_foreach_folder_summary(favorites_bookmark_folder_summary_cb callback, void *user_data);
+
+/**
+ * @brief   The bookmark snapshot handle.
+ * @see favorites_bookmark_snapshot_open()
+ */
+typedef struct favorites_bookmark_snapshot *favorites_bookmark_snapshot_h;
+
+/**
+ * @brief       Writes the bookmark hierarchy to a snapshot file.
+ *
+ * @details A snapshot holds what favorites_bookmark_foreach_tree() returns, in a flat
+ * binary file that favorites_bookmark_snapshot_open() maps without any database access.
+ * The file is replaced atomically, and left alone if it is already up to date.
+ *
+ * @param[in]   path	The path of the snapshot file
+ *
+ * @return  0 on success, otherwise a negative error value.
+ * @retval  #FAVORITES_ERROR_NONE                Successful
+ * @retval  #FAVORITES_ERROR_INVALID_PARAMETER   Invalid parameter, or the file cannot be written
+ * @retval  #FAVORITES_ERROR_DB_FAILED           Database failed
+ *
+ * @see favorites_bookmark_set_snapshot_path()
+ */
+int favorites_bookmark_snapshot_write(const char *path);
+
+/**
+ * @brief       Sets the snapshot file kept up to date by this process.
+ *
+ * @details The snapshot is written at once if needed, then again after every bookmark
+ * change made through this library by this process. Changes made by other processes are
+ * only picked up by the next favorites_bookmark_snapshot_write().
+ *
+ * @remarks  Every change rewrites the whole snapshot. Unset the path around bulk changes
+ * and write the snapshot once afterwards.
+ * @param[in]   path	The path of the snapshot file, or @c NULL to stop updating it
+ *
+ * @return  0 on success, otherwise a negative error value.
+ * @retval  #FAVORITES_ERROR_NONE                Successful
+ * @retval  #FAVORITES_ERROR_INVALID_PARAMETER   The file cannot be written
+ * @retval  #FAVORITES_ERROR_DB_FAILED           Database failed
+ *
+ * @see favorites_bookmark_snapshot_write()
+ */
+int favorites_bookmark_set_snapshot_path(const char *path);
+
+/**
+ * @brief       Maps a snapshot file written by favorites_bookmark_snapshot_write().
+ *
+ * @param[in]   path	The path of the snapshot file
+ * @param[out]  snapshot	The snapshot handle, to release with favorites_bookmark_snapshot_close()
+ *
+ * @return  0 on success, otherwise a negative error value.
+ * @retval  #FAVORITES_ERROR_NONE                Successful
+ * @retval  #FAVORITES_ERROR_INVALID_PARAMETER   Invalid parameter, or the file is missing or not a snapshot
+ *
+ * @see favorites_bookmark_snapshot_foreach()
+ */
+int favorites_bookmark_snapshot_open(const char *path, favorites_bookmark_snapshot_h *snapshot);
+
+/**
+ * @brief       Retrieves the bookmark hierarchy of a snapshot depth-first by invoking the given callback function iteratively.
+ *
+ * @details The items come in the order of favorites_bookmark_foreach_tree(). Nothing is
+ * allocated: the strings of the items point into the mapped file.
+ *
+ * @remarks  The strings of an item must not be modified, and are only valid until the
+ * snapshot is closed.
+ * @param[in]   snapshot	The snapshot handle
+ * @param[in]   callback	The callback function to invoke
+ * @param[in]   user_data	The user data to be passed to the callback function
+ *
+ * @return  0 on success, otherwise a negative error value.
+ * @retval  #FAVORITES_ERROR_NONE                Successful
+ * @retval  #FAVORITES_ERROR_INVALID_PARAMETER   Invalid parameter
+ *
+ * @post	This function invokes favorites_bookmark_tree_cb() repeatedly for each item.
+ */
+int favorites_bookmark_snapshot_foreach(favorites_bookmark_snapshot_h snapshot,
+		favorites_bookmark_tree_cb callback, void *user_data);
+
+/**
+ * @brief       Unmaps a snapshot opened by favorites_bookmark_snapshot_open().
+ *
+ * @param[in]   snapshot	The snapshot handle
+ *
+ * @return  0 on success, otherwise a negative error value.
+ * @retval  #FAVORITES_ERROR_NONE                Successful
+ * @retval  #FAVORITES_ERROR_INVALID_PARAMETER   Invalid parameter
+ */
+int favorites_bookmark_snapshot_close(favorites_bookmark_snapshot_h snapshot);
+
 /**
  * @brief       Exports a whole bookmark list as a netscape HTML bookmark file.
  *
@@ -177,6 +441,125 @@ int favorites_bookmark_export_list(const char *file_path);
  */
 int favorites_bookmark_get_favicon(int bookmark_id, Evas *evas, Evas_Object **icon);
 
+/**
+ * @brief       Gets the bookmark's favicon as a evas object type, in the size closest to the hint
+ *
+ * @details Downscaled copies of 16, 32 and 64 pixels are stored with each favicon moved to
+ * the shared favicon table by favorites_bookmark_deduplicate_favicons(). The smallest copy
+ * not smaller than @a size_hint is returned, or the original image if there is none.
+ *
+ * @param[in]   bookmark_id	The unique ID of bookmark
+ * @param[in]   size_hint	The size in pixels the icon will be shown at, or 0 for the original size
+ * @param[in]   evas	The given canvas
+ * @param[out]  icon	Retrieved favicon evas object of bookmark.
+ *
+ * @return  0 on success, otherwise a negative error value.
+ * @retval  #FAVORITES_ERROR_NONE                Successful
+ * @retval  #FAVORITES_ERROR_INVALID_PARAMETER   Invalid parameter
+ * @retval  #FAVORITES_ERROR_DB_FAILED           Database failed
+ *
+ * @see favorites_bookmark_get_favicon()
+ */
+int favorites_bookmark_get_favicon_with_size(int bookmark_id, int size_hint, Evas *evas, Evas_Object **icon);
+
+/**
+ * @brief       Called to get the favicon of each bookmark requested from favorites_bookmark_get_favicons().
+ *
+ * @param[in]   bookmark_id	The unique ID of the bookmark
+ * @param[in]   icon	The favicon evas object of the bookmark, owned by the caller
+ * @param[in]   user_data	The user data passed from favorites_bookmark_get_favicons()
+ *
+ * @return @c true to continue with the next favicon or @c false to stop.
+ *
+ * @pre		favorites_bookmark_get_favicons() will invoke this callback.
+ *
+ * @see		favorites_bookmark_get_favicons()
+ */
+typedef bool (*favorites_bookmark_favicon_cb)(int bookmark_id, Evas_Object *icon, void *user_data);
+
+/**
+ * @brief       Gets the favicons of several bookmarks at once as evas objects.
+ *
+ * @details The favicons are read with one database query for the whole list, which
+ * is much faster than calling favorites_bookmark_get_favicon() for each bookmark.
+ *
+ * @remarks  The callback is invoked only for bookmarks that have a favicon, and not
+ * necessarily in the order of @a bookmark_ids.
+ * @param[in]   bookmark_ids	The array of unique IDs of the bookmarks
+ * @param[in]   count	The number of IDs in @a bookmark_ids
+ * @param[in]   size_hint	The size in pixels the icons will be shown at, or 0 for the original size.
+ * See favorites_bookmark_get_favicon_with_size().
+ * @param[in]   evas	The given canvas
+ * @param[in]   callback	The callback function to invoke
+ * @param[in]   user_data	The user data to be passed to the callback function
+ *
+ * @return  0 on success, otherwise a negative error value.
+ * @retval  #FAVORITES_ERROR_NONE                Successful
+ * @retval  #FAVORITES_ERROR_INVALID_PARAMETER   Invalid parameter
+ * @retval  #FAVORITES_ERROR_DB_FAILED           Database failed
+ *
+ * @post	This function invokes favorites_bookmark_favicon_cb() for each found favicon.
+ *
+ * @see favorites_bookmark_favicon_cb()
+ */
+int favorites_bookmark_get_favicons(const int *bookmark_ids, int count, int size_hint,
+		Evas *evas, favorites_bookmark_favicon_cb callback, void *user_data);
+
+/**
+ * @brief       Sets the memory budget of the favicon cache.
+ *
+ * @details favorites_bookmark_get_favicon() keeps recently used favicons in memory
+ * and serves them without reading the database. Icons of the same bookmark share
+ * one pixel buffer, which is released when the last image object using it is deleted.
+ *
+ * @remarks  The default budget is 2MB. Pass 0 to disable the cache.
+ * @remarks  The pixel data of the returned icons must not be modified.
+ * @param[in]   bytes	The maximum number of bytes of favicon data to keep cached
+ *
+ * @return  0 on success, otherwise a negative error value.
+ * @retval  #FAVORITES_ERROR_NONE                Successful
+ * @retval  #FAVORITES_ERROR_INVALID_PARAMETER   Invalid parameter
+ *
+ */
+int favorites_bookmark_set_favicon_cache_size(int bytes);
+
+/**
+ * @brief       Moves favicons stored inline in bookmarks to the shared favicon table.
+ *
+ * @details Identical favicons are stored once and shared by every bookmark using them.
+ * A shared favicon is deleted together with the last bookmark referring to it.
+ * favorites_bookmark_get_favicon() reads both inline and shared favicons, so this can
+ * be run at any time, e.g. when the device is idle. It only touches bookmarks whose
+ * favicon was written inline since the last run.
+ *
+ * @remarks  After the move, the favicon columns of the bookmark table are empty.
+ * Every reader of favicons must use favorites_bookmark_get_favicon().
+ * @param[out]  moved_count	The number of bookmarks whose favicon was moved. This can be @c NULL.
+ *
+ * @return  0 on success, otherwise a negative error value.
+ * @retval  #FAVORITES_ERROR_NONE                Successful
+ * @retval  #FAVORITES_ERROR_DB_FAILED           Database failed
+ *
+ */
+int favorites_bookmark_deduplicate_favicons(int *moved_count);
+
+/**
+ * @brief       Enables or disables the in-process bookmark read cache.
+ *
+ * @details When enabled, favorites_bookmark_foreach() and favorites_bookmark_export_list()
+ * are answered from an in-memory copy of the bookmark list. Counts are always read from
+ * counters kept in the database. The copy is checked against the database change counter on
+ * every call, so changes made by other processes are picked up immediately.
+ *
+ * @remarks  The cache is disabled by default.
+ * @param[in]   enabled	@c true to enable the cache, @c false to disable it and release its memory
+ *
+ * @return  0 on success, otherwise a negative error value.
+ * @retval  #FAVORITES_ERROR_NONE                Successful
+ *
+ */
+int favorites_bookmark_set_cache_enabled(bool enabled);
+
 /**
  * @brief   The structure of history entry in search results.
  *
@@ -290,6 +673,539 @@ int favorites_history_delete_all_histories(void);
  */
 int favorites_history_delete_history_by_term(const char *begin_date, const char *end_date);
 
+/**
+ * @brief       Called to report the progress of favorites_history_delete_history_by_term_incremental().
+ *
+ * @param[in]   deleted_count	The number of histories deleted so far
+ * @param[in]   total_count	The estimated number of histories to delete in total
+ * @param[in]   user_data	The user data passed from the delete function
+ *
+ * @return @c true to continue with the next batch or @c false to stop deleting.
+ *
+ * @pre		favorites_history_delete_history_by_term_incremental() will invoke this callback.
+ *
+ * @see		favorites_history_delete_history_by_term_incremental()
+ */
+typedef bool (*favorites_history_delete_progress_cb)(int deleted_count, int total_count, void *user_data);
+
+/**
+ * @brief       Deletes all histories accessed with the browser within the specified time period, in batches.
+ *
+ * @details The histories are deleted oldest first, @a batch_size at a time, and every batch is
+ * committed separately. Other processes can write to the history between two batches, so a large
+ * deletion does not hold the database lock for long.
+ *
+ * @remarks  Date format must be "yyyy-mm-dd hh:mm:ss" ex: "2000-01-01 01:20:35".
+ * @remarks  Stopping from the callback keeps the batches already deleted.
+ * @param[in]   begin_date         The start date of the period
+ * @param[in]   end_date           The end date of the period, @c NULL for now
+ * @param[in]   batch_size         The maximum number of histories deleted per transaction
+ * @param[in]   callback           The callback function invoked after every batch. This can be @c NULL.
+ * @param[in]   user_data          The user data to be passed to the callback function
+ * @param[out]  deleted_count      The number of deleted histories. This can be @c NULL.
+ *
+ * @return  0 on success, otherwise a negative error value.
+ * @retval  #FAVORITES_ERROR_NONE                Successful
+ * @retval  #FAVORITES_ERROR_INVALID_PARAMETER   Invalid parameter
+ * @retval  #FAVORITES_ERROR_DB_FAILED           Database failed
+ *
+ * @post	This function invokes favorites_history_delete_progress_cb() after every batch.
+ *
+ * @see favorites_history_delete_history_by_term()
+ */
+int favorites_history_delete_history_by_term_incremental(const char *begin_date, const char *end_date,
+		int batch_size, favorites_history_delete_progress_cb callback, void *user_data,
+		int *deleted_count);
+
+/**
+ * @brief       Records a visit to the given url.
+ *
+ * @details Visits are buffered in memory, visits to the same url being merged into one,
+ * and written together in one transaction: the counter of the url's history is
+ * increased and its visit date updated, or a new history is added. The buffer is written
+ * once it holds 32 urls, when a visit is recorded 10 seconds or more after the oldest
+ * buffered one, by favorites_history_flush(), before any other history function and
+ * when the process exits normally. No timer writes the buffer: with no further visit,
+ * the buffered ones stay in memory however old they are.
+ *
+ * @remarks  Call favorites_history_flush() when the visits must reach the database, e.g.
+ * when the application goes idle or to the background, where it may be killed.
+ * @param[in]   url	The visited url
+ * @param[in]   title	The title of the page. This can be @c NULL to keep the current title.
+ *
+ * @return  0 on success, otherwise a negative error value.
+ * @retval  #FAVORITES_ERROR_NONE                Successful
+ * @retval  #FAVORITES_ERROR_INVALID_PARAMETER   Invalid parameter
+ * @retval  #FAVORITES_ERROR_DB_FAILED           Database failed, the visit stays buffered
+ *
+ * @see favorites_history_flush()
+ */
+int favorites_history_record_visit(const char *url, const char *title);
+
+/**
+ * @brief       Writes the visits buffered by favorites_history_record_visit().
+ *
+ * @return  0 on success, otherwise a negative error value.
+ * @retval  #FAVORITES_ERROR_NONE                Successful
+ * @retval  #FAVORITES_ERROR_DB_FAILED           Database failed, the visits stay buffered
+ *
+ * @see favorites_history_record_visit()
+ */
+int favorites_history_flush(void);
+
+/**
+ * @brief   The structure of the history of one host, passed to favorites_history_host_cb().
+ *
+ * @details The strings belong to the library and are only valid during the callback.
+ */
+typedef struct {
+	char* host;	/**< The host name, case folded, without the user info and the port */
+	char* last_visit_date;	/**< The last visit date of the pages of the host */
+	int visit_count;	/**< The number of visits to the pages of the host */
+	int page_count;	/**< The number of histories, i.e. distinct urls, of the host */
+} favorites_history_host_s;
+
+/**
+ * @brief Enumerations for the order of favorites_history_foreach_host().
+ */
+typedef enum {
+	FAVORITES_HISTORY_HOST_ORDER_MOST_VISITED = 0,	/**< The hosts with the most visits first */
+	FAVORITES_HISTORY_HOST_ORDER_RECENTLY_VISITED,	/**< The most recently visited hosts first */
+	FAVORITES_HISTORY_HOST_ORDER_MOST_PAGES	/**< The hosts with the most distinct urls first */
+} favorites_history_host_order_e;
+
+/**
+ * @brief       Called to get the history of each host.
+ *
+ * @param[in]   item	The host history
+ * @param[in]   user_data	The user data passed from the foreach function
+ *
+ * @return @c true to continue with the next iteration of the loop or @c false to break out of the loop.
+ *
+ * @pre		favorites_history_foreach_host() will invoke this callback.
+ *
+ * @see		favorites_history_foreach_host()
+ */
+typedef bool (*favorites_history_host_cb)(favorites_history_host_s *item, void *user_data);
+
+/**
+ * @brief       Retrieves the visits, pages and last visit of each host by invoking the given callback function iteratively.
+ *
+ * @details The per host figures are kept up to date in the database as histories are
+ * added, visited and deleted, so this reads one row per host and does not scan the history.
+ * Urls without a host, e.g. file urls or about:blank, are not counted.
+ *
+ * @param[in]   order	The order of the hosts
+ * @param[in]   limit	The maximum number of hosts, 0 for all
+ * @param[in]   callback	The callback function to invoke
+ * @param[in]   user_data	The user data to be passed to the callback function
+ *
+ * @return  0 on success, otherwise a negative error value.
+ * @retval  #FAVORITES_ERROR_NONE                Successful
+ * @retval  #FAVORITES_ERROR_INVALID_PARAMETER   Invalid parameter
+ * @retval  #FAVORITES_ERROR_DB_FAILED           Database failed
+ *
+ * @post	This function invokes favorites_history_host_cb() repeatedly for each host.
+ *
+ * @see favorites_history_host_cb()
+ */
+int favorites_history_foreach_host(favorites_history_host_order_e order, int limit,
+		favorites_history_host_cb callback, void *user_data);
+
+/**
+ * @brief Enumerations for the order in which the history retention policy drops histories.
+ */
+typedef enum {
+	FAVORITES_HISTORY_RETENTION_OLDEST_FIRST = 0,	/**< Drop the least recently visited histories first */
+	FAVORITES_HISTORY_RETENTION_LEAST_FRECENT_FIRST	/**< Drop the histories with the lowest visit count, weighted by recency, first */
+} favorites_history_retention_order_e;
+
+/**
+ * @brief       Sets the retention policy of the history.
+ *
+ * @details The policy is enforced by favorites_history_maintain(). Histories older than
+ * @a max_age_days are always dropped first; when the history is still over @a max_count
+ * entries or @a max_size bytes, more histories are dropped in the given @a order.
+ *
+ * @remarks  The policy applies to the calling process only. By default there is no limit.
+ * @param[in]   max_age_days	The maximum age of a history in days, 0 for no limit
+ * @param[in]   max_count	The maximum number of histories, 0 for no limit
+ * @param[in]   max_size	The maximum size in bytes of the history data, 0 for no limit
+ * @param[in]   order	The order in which histories are dropped to meet @a max_count and @a max_size
+ *
+ * @return  0 on success, otherwise a negative error value.
+ * @retval  #FAVORITES_ERROR_NONE                Successful
+ * @retval  #FAVORITES_ERROR_INVALID_PARAMETER   Invalid parameter
+ *
+ * @see favorites_history_maintain()
+ */
+int favorites_history_set_retention_policy(int max_age_days, int max_count,
+		long long max_size, favorites_history_retention_order_e order);
+
+/**
+ * @brief       Enforces the history retention policy by one bounded step.
+ *
+ * @details Deletes at most @a budget histories, in a few short transactions. Call it
+ * periodically, e.g. from an idle handler, until @a deleted_count is 0.
+ *
+ * @param[in]   budget	The maximum number of histories to delete, 0 for the default of 100
+ * @param[out]  deleted_count	The number of deleted histories. This can be @c NULL.
+ *
+ * @return  0 on success, otherwise a negative error value.
+ * @retval  #FAVORITES_ERROR_NONE                Successful
+ * @retval  #FAVORITES_ERROR_INVALID_PARAMETER   Invalid parameter
+ * @retval  #FAVORITES_ERROR_DB_FAILED           Database failed
+ *
+ * @see favorites_history_set_retention_policy()
+ */
+int favorites_history_maintain(int budget, int *deleted_count);
+
+/**
+ * @brief       Tells quickly whether the given url may be bookmarked or in the history.
+ *
+ * @details The answer comes from an in-memory filter over the normalized urls of the
+ * bookmarks and the history, so it can be asked for every link of a page. @c false is
+ * certain; @c true may be a false positive, to be confirmed with favorites_url_is_known().
+ * The filter is built on the first call. Urls added through this library are known at
+ * once, urls added by other processes after at most one second.
+ *
+ * @param[in]   url	The url to check
+ * @param[out]  maybe_known	@c true if the url may be bookmarked or visited, @c false if it is not
+ *
+ * @return  0 on success, otherwise a negative error value.
+ * @retval  #FAVORITES_ERROR_NONE                Successful
+ * @retval  #FAVORITES_ERROR_INVALID_PARAMETER   Invalid parameter
+ * @retval  #FAVORITES_ERROR_DB_FAILED           Database failed
+ *
+ * @see favorites_url_is_known()
+ * @see favorites_url_set_false_positive_rate()
+ */
+int favorites_url_maybe_known(const char *url, bool *maybe_known);
+
+/**
+ * @brief       Checks whether the given url is bookmarked and whether it is in the history.
+ *
+ * @details The url must match the address of a bookmark or history exactly.
+ *
+ * @param[in]   url	The url to check
+ * @param[out]  is_bookmarked	@c true if a bookmark has this url. This can be @c NULL to skip the check.
+ * @param[out]  is_visited	@c true if a history has this url. This can be @c NULL to skip the check.
+ *
+ * @return  0 on success, otherwise a negative error value.
+ * @retval  #FAVORITES_ERROR_NONE                Successful
+ * @retval  #FAVORITES_ERROR_INVALID_PARAMETER   Invalid parameter
+ * @retval  #FAVORITES_ERROR_DB_FAILED           Database failed
+ *
+ * @see favorites_url_maybe_known()
+ */
+int favorites_url_is_known(const char *url, bool *is_bookmarked, bool *is_visited);
+
+/**
+ * @brief       Sets the false positive rate of favorites_url_maybe_known().
+ *
+ * @details A lower rate takes more memory: about 10 bits per url for the default
+ * of 0.01, 15 bits for 0.001. The filter is rebuilt on the next check.
+ *
+ * @param[in]   rate	The rate, greater than 0 and lower than 1
+ *
+ * @return  0 on success, otherwise a negative error value.
+ * @retval  #FAVORITES_ERROR_NONE                Successful
+ * @retval  #FAVORITES_ERROR_INVALID_PARAMETER   Invalid parameter
+ *
+ * @see favorites_url_maybe_known()
+ */
+int favorites_url_set_false_positive_rate(double rate);
+
+/**
+ * @brief       Makes the process a reader of the bookmark and history databases.
+ *
+ * @details In read-only mode the databases are opened read-only, without the db-util
+ * hooks nor a shared cache, and with query_only set, so the process never takes a write
+ * lock. With WAL journaling, readers then never block the browser. The functions which
+ * modify the databases return #FAVORITES_ERROR_READ_ONLY; the schema upgrades are left to
+ * the writing processes.
+ *
+ * @remarks  The mode applies to the calling process only, from the next database access.
+ * Set it once, before any other call.
+ * @param[in]   read_only	@c true for read-only mode, @c false for the default read-write mode
+ *
+ * @return  0 on success, otherwise a negative error value.
+ * @retval  #FAVORITES_ERROR_NONE                Successful
+ */
+int favorites_db_set_read_only(bool read_only);
+
+/**
+ * @brief       Converts the bookmark and history databases to incremental vacuum.
+ *
+ * @details Once converted, the pages freed by deletions can be given back to the
+ * file system in small steps with favorites_db_compact().
+ *
+ * @remarks  The conversion rebuilds each database that is not converted yet, which
+ * takes as long as a full VACUUM. Run it once, e.g. at install or upgrade time.
+ *
+ * @return  0 on success, otherwise a negative error value.
+ * @retval  #FAVORITES_ERROR_NONE                Successful
+ * @retval  #FAVORITES_ERROR_DB_FAILED           Database failed
+ *
+ * @see favorites_db_compact()
+ */
+int favorites_db_enable_incremental_vacuum(void);
+
+/**
+ * @brief       Gives free pages of the bookmark and history databases back to the file system.
+ *
+ * @details At most @a budget_pages pages are reclaimed per call, so the databases are only
+ * locked briefly. Call it after large deletions until @a freed_pages is 0.
+ *
+ * @remarks  Databases not converted by favorites_db_enable_incremental_vacuum() are left as they are.
+ * @param[in]   budget_pages	The maximum number of pages to reclaim
+ * @param[out]  freed_pages	The number of pages reclaimed. This can be @c NULL.
+ *
+ * @return  0 on success, otherwise a negative error value.
+ * @retval  #FAVORITES_ERROR_NONE                Successful
+ * @retval  #FAVORITES_ERROR_INVALID_PARAMETER   Invalid parameter
+ * @retval  #FAVORITES_ERROR_DB_FAILED           Database failed
+ *
+ * @see favorites_db_enable_incremental_vacuum()
+ */
+int favorites_db_compact(int budget_pages, int *freed_pages);
+
+/**
+ * @brief       Checks the bookmark and history databases for inconsistencies.
+ *
+ * @details Each database gets an SQLite quick_check, then its item counts, per folder
+ * counts, per host aggregates and url hashes are compared with the rows, on one snapshot.
+ * A non-zero result after concurrent use means updates were lost or half applied. Each
+ * kind of violation found is logged.
+ *
+ * @remarks  This reads whole tables; call it from test and diagnostic tools, not on a
+ * user-facing path.
+ * @param[out]  violations	The number of violations found, 0 if the databases are consistent
+ *
+ * @return  0 on success, otherwise a negative error value.
+ * @retval  #FAVORITES_ERROR_NONE                Successful
+ * @retval  #FAVORITES_ERROR_INVALID_PARAMETER   Invalid parameter
+ * @retval  #FAVORITES_ERROR_DB_FAILED           Database failed
+ *
+ * @see favorites_db_foreach_lock_stats()
+ * @see favorites_trace_foreach_event()
+ */
+int favorites_db_check_integrity(int *violations);
+
+/**
+ * @brief       Sets how long the library waits for a database locked by another connection.
+ *
+ * @details When a database is locked, e.g. by the browser writing at the same time, the
+ * operation is retried after a backoff that doubles from @a initial_backoff_ms up to
+ * @a max_backoff_ms, half of it being random. It fails with #FAVORITES_ERROR_DB_FAILED
+ * once it waited @a timeout_ms in total or retried @a max_attempts times. By default
+ * it waits up to 1000 ms, with a backoff from 1 to 64 ms, for 32 attempts at most.
+ *
+ * @remarks  The policy applies to the calling process only.
+ * @param[in]   timeout_ms	The maximum wait in milliseconds, 0 not to wait
+ * @param[in]   initial_backoff_ms	The first backoff in milliseconds
+ * @param[in]   max_backoff_ms	The maximum backoff in milliseconds
+ * @param[in]   max_attempts	The maximum number of retries, 0 for no limit but the timeout
+ *
+ * @return  0 on success, otherwise a negative error value.
+ * @retval  #FAVORITES_ERROR_NONE                Successful
+ * @retval  #FAVORITES_ERROR_INVALID_PARAMETER   Invalid parameter
+ *
+ * @see favorites_db_foreach_lock_stats()
+ */
+int favorites_db_set_busy_policy(int timeout_ms, int initial_backoff_ms,
+		int max_backoff_ms, int max_attempts);
+
+/**
+ * @brief   The structure of the lock waits of one function, passed to favorites_db_lock_stats_cb().
+ */
+typedef struct {
+	const char* api;	/**< The name of the public function which waited */
+	int busy_count;	/**< The number of times the function found a database locked */
+	int retry_count;	/**< The number of retries after a backoff */
+	int failure_count;	/**< The number of times the busy policy gave up */
+	long long wait_ms;	/**< The total time spent waiting, in milliseconds */
+	int max_wait_ms;	/**< The longest wait for one lock, in milliseconds */
+} favorites_db_lock_stats_s;
+
+/**
+ * @brief       Called to get the lock waits of each function.
+ *
+ * @param[in]   stats	The lock waits of a function
+ * @param[in]   user_data	The user data passed from the foreach function
+ *
+ * @return @c true to continue with the next iteration of the loop or @c false to break out of the loop.
+ *
+ * @pre		favorites_db_foreach_lock_stats() will invoke this callback.
+ *
+ * @see		favorites_db_foreach_lock_stats()
+ */
+typedef bool (*favorites_db_lock_stats_cb)(const favorites_db_lock_stats_s *stats, void *user_data);
+
+/**
+ * @brief       Retrieves the lock waits of the process by invoking the given callback function iteratively.
+ *
+ * @details Only the functions which found a database locked since the start of the
+ * process, or the last favorites_db_reset_lock_stats(), are reported.
+ *
+ * @param[in]   callback	The callback function to invoke
+ * @param[in]   user_data	The user data to be passed to the callback function
+ *
+ * @return  0 on success, otherwise a negative error value.
+ * @retval  #FAVORITES_ERROR_NONE                Successful
+ * @retval  #FAVORITES_ERROR_INVALID_PARAMETER   Invalid parameter
+ * @retval  #FAVORITES_ERROR_DB_FAILED           Out of memory
+ *
+ * @post	This function invokes favorites_db_lock_stats_cb() repeatedly for each function.
+ *
+ * @see favorites_db_set_busy_policy()
+ * @see favorites_db_reset_lock_stats()
+ */
+int favorites_db_foreach_lock_stats(favorites_db_lock_stats_cb callback, void *user_data);
+
+/**
+ * @brief       Clears the lock waits reported by favorites_db_foreach_lock_stats().
+ *
+ * @return  0 on success, otherwise a negative error value.
+ * @retval  #FAVORITES_ERROR_NONE                Successful
+ */
+int favorites_db_reset_lock_stats(void);
+
+/**
+ * @brief Enumerations for the levels of the library logs and trace events.
+ */
+typedef enum {
+	FAVORITES_TRACE_LEVEL_NONE = 0,	/**< Nothing */
+	FAVORITES_TRACE_LEVEL_ERROR,	/**< Errors only, the default */
+	FAVORITES_TRACE_LEVEL_WARNING,	/**< Warnings and above */
+	FAVORITES_TRACE_LEVEL_INFO,	/**< Informations and above, and a trace event per database access */
+	FAVORITES_TRACE_LEVEL_DEBUG	/**< Everything, with trace events for the caches and lookups */
+} favorites_trace_level_e;
+
+/**
+ * @brief   The structure of a trace event, passed to favorites_trace_event_cb().
+ */
+typedef struct {
+	const char* api;	/**< The name of the function which recorded the event */
+	const char* phase;	/**< What was timed, e.g. "bookmark db" for a database connection */
+	unsigned long long start_us;	/**< The start time on the monotonic clock, in microseconds */
+	unsigned int duration_us;	/**< The duration in microseconds */
+	int rows;	/**< The rows read or written, depending on the phase */
+	unsigned long thread_id;	/**< The thread which recorded the event */
+} favorites_trace_event_s;
+
+/**
+ * @brief       Called to get each recorded trace event.
+ *
+ * @param[in]   event	The trace event
+ * @param[in]   user_data	The user data passed from the foreach function
+ *
+ * @return @c true to continue with the next iteration of the loop or @c false to break out of the loop.
+ *
+ * @pre		favorites_trace_foreach_event() will invoke this callback.
+ *
+ * @see		favorites_trace_foreach_event()
+ */
+typedef bool (*favorites_trace_event_cb)(const favorites_trace_event_s *event, void *user_data);
+
+/**
+ * @brief       Sets the level of the library logs and trace events.
+ *
+ * @details Below the level, a log or trace point costs one comparison: nothing is
+ * formatted nor timed. From #FAVORITES_TRACE_LEVEL_INFO, trace events are recorded into
+ * a ring of the 255 latest events per thread, to be read with favorites_trace_foreach_event().
+ *
+ * @remarks  The level applies to the calling process only. Levels above the
+ * FAVORITES_TRACE_MAX_LEVEL the library was built with have no effect.
+ * @param[in]   level	The level
+ *
+ * @return  0 on success, otherwise a negative error value.
+ * @retval  #FAVORITES_ERROR_NONE                Successful
+ * @retval  #FAVORITES_ERROR_INVALID_PARAMETER   Invalid parameter
+ *
+ * @see favorites_trace_foreach_event()
+ */
+int favorites_trace_set_level(favorites_trace_level_e level);
+
+/**
+ * @brief       Retrieves the recorded trace events of every thread by invoking the given callback function iteratively.
+ *
+ * @details The events of a thread come oldest first. The rings of exited threads are dropped.
+ *
+ * @param[in]   callback	The callback function to invoke
+ * @param[in]   user_data	The user data to be passed to the callback function
+ *
+ * @return  0 on success, otherwise a negative error value.
+ * @retval  #FAVORITES_ERROR_NONE                Successful
+ * @retval  #FAVORITES_ERROR_INVALID_PARAMETER   Invalid parameter
+ * @retval  #FAVORITES_ERROR_DB_FAILED           Out of memory
+ *
+ * @post	This function invokes favorites_trace_event_cb() repeatedly for each event.
+ *
+ * @see favorites_trace_set_level()
+ */
+int favorites_trace_foreach_event(favorites_trace_event_cb callback, void *user_data);
+
+/**
+ * @brief       Called after each step of favorites_backup() and favorites_restore().
+ *
+ * @param[in]   copied_pages	The number of pages copied so far
+ * @param[in]   total_pages	The number of pages of both databases to copy: the live ones when a backup starts, the saved ones for a restore
+ * @param[in]   user_data	The user data passed from the backup function
+ *
+ * @return @c true to continue with the copy or @c false to cancel it.
+ *
+ * @see		favorites_backup()
+ * @see		favorites_restore()
+ */
+typedef bool (*favorites_backup_progress_cb)(int copied_pages, int total_pages, void *user_data);
+
+/**
+ * @brief       Saves the bookmark and history databases while they are in use.
+ *
+ * @details The databases are written to the files bookmark.db and history.db in
+ * @a dest_path, @a pages_per_step pages at a time. They are only locked during a step,
+ * so other processes can write in between; when one does, the copy of that database
+ * starts over to stay consistent. The backup fails when a copy keeps starting over or
+ * the database stays locked.
+ *
+ * @param[in]   dest_path	The existing directory to save the databases to
+ * @param[in]   pages_per_step	The number of pages copied per step, which bounds how long the databases are locked
+ * @param[in]   callback	The callback function to invoke after each step. This can be @c NULL.
+ * @param[in]   user_data	The user data to be passed to the callback function
+ *
+ * @return  0 on success or when cancelled, otherwise a negative error value.
+ * @retval  #FAVORITES_ERROR_NONE                Successful
+ * @retval  #FAVORITES_ERROR_INVALID_PARAMETER   Invalid parameter
+ * @retval  #FAVORITES_ERROR_DB_FAILED           Database failed, or the copy could not complete
+ *
+ * @see favorites_restore()
+ */
+int favorites_backup(const char *dest_path, int pages_per_step,
+		favorites_backup_progress_cb callback, void *user_data);
+
+/**
+ * @brief       Replaces the bookmark and history databases by a backup made with favorites_backup().
+ *
+ * @details The bookmark database is restored first, then the history database. A cancelled
+ * or failed restore leaves the database being restored unchanged.
+ *
+ * @remarks  Other writers are blocked until each database is restored.
+ * @param[in]   src_path	The directory holding the backup
+ * @param[in]   pages_per_step	The number of pages copied per step
+ * @param[in]   callback	The callback function to invoke after each step. This can be @c NULL.
+ * @param[in]   user_data	The user data to be passed to the callback function
+ *
+ * @return  0 on success or when cancelled, otherwise a negative error value.
+ * @retval  #FAVORITES_ERROR_NONE                Successful
+ * @retval  #FAVORITES_ERROR_INVALID_PARAMETER   Invalid parameter, or the backup is incomplete
+ * @retval  #FAVORITES_ERROR_DB_FAILED           Database failed, or the copy could not complete
+ *
+ * @see favorites_backup()
+ */
+int favorites_restore(const char *src_path, int pages_per_step,
+		favorites_backup_progress_cb callback, void *user_data);
+
 /**
  * @}
  */
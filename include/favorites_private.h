@@ -24,21 +24,66 @@ extern "C" {
 /**********************************************
  * Logging macro
  **********************************************/
-#define FAVORITES_LOGD(fmt, args...) LOGD(\
-		"[%s: %s: %d] "fmt, (rindex(__FILE__, '/')? rindex(__FILE__, '/') + 1 : __FILE__),\
-		__FUNCTION__, __LINE__, ##args)
-#define FAVORITES_LOGI(fmt, args...) LOGI(\
-		"[%s: %s: %d] "fmt, (rindex(__FILE__, '/') ? rindex(__FILE__, '/') + 1 : __FILE__),\
-		__FUNCTION__, __LINE__, ##args)
-#define FAVORITES_LOGW(fmt, args...) LOGW(\
-		"[%s: %s: %d] "fmt, (rindex(__FILE__, '/') ? rindex(__FILE__, '/') + 1 : __FILE__),\
-		__FUNCTION__, __LINE__, ##args)
-#define FAVORITES_LOGE(fmt, args...) LOGE(\
-		"[%s: %s: %d] "fmt, (rindex(__FILE__, '/') ? rindex(__FILE__, '/') + 1 : __FILE__),\
-		__FUNCTION__, __LINE__, ##args)
-#define FAVORITES_LOGE_IF(cond, fmt, args...) LOGE_IF(cond,\
-		"[%s: %s: %d] "fmt, (rindex(__FILE__, '/') ? rindex(__FILE__, '/') + 1 : __FILE__),\
-		__FUNCTION__, __LINE__, ##args)
+/* Levels above FAVORITES_TRACE_MAX_LEVEL are compiled out, the others are
+ * checked against favorites_trace_set_level() before any formatting. */
+#ifndef FAVORITES_TRACE_MAX_LEVEL
+#define FAVORITES_TRACE_MAX_LEVEL	FAVORITES_TRACE_LEVEL_DEBUG
+#endif
+extern int gl_favorites_trace_level;
+#define FAVORITES_TRACE_ON(_level_) \
+	((_level_) <= FAVORITES_TRACE_MAX_LEVEL && (_level_) <= gl_favorites_trace_level)
+
+/* base name of the source file, folded at compile time */
+#define FAVORITES_FILE \
+	(__builtin_strrchr(__FILE__, '/') ? __builtin_strrchr(__FILE__, '/') + 1 : __FILE__)
+
+#define FAVORITES_LOGD(fmt, args...) do { \
+	if (FAVORITES_TRACE_ON(FAVORITES_TRACE_LEVEL_DEBUG)) LOGD(\
+		"[%s: %s: %d] "fmt, FAVORITES_FILE, __FUNCTION__, __LINE__, ##args); \
+}while(0)
+#define FAVORITES_LOGI(fmt, args...) do { \
+	if (FAVORITES_TRACE_ON(FAVORITES_TRACE_LEVEL_INFO)) LOGI(\
+		"[%s: %s: %d] "fmt, FAVORITES_FILE, __FUNCTION__, __LINE__, ##args); \
+}while(0)
+#define FAVORITES_LOGW(fmt, args...) do { \
+	if (FAVORITES_TRACE_ON(FAVORITES_TRACE_LEVEL_WARNING)) LOGW(\
+		"[%s: %s: %d] "fmt, FAVORITES_FILE, __FUNCTION__, __LINE__, ##args); \
+}while(0)
+#define FAVORITES_LOGE(fmt, args...) do { \
+	if (FAVORITES_TRACE_ON(FAVORITES_TRACE_LEVEL_ERROR)) LOGE(\
+		"[%s: %s: %d] "fmt, FAVORITES_FILE, __FUNCTION__, __LINE__, ##args); \
+}while(0)
+#define FAVORITES_LOGE_IF(cond, fmt, args...) do { \
+	if (FAVORITES_TRACE_ON(FAVORITES_TRACE_LEVEL_ERROR)) LOGE_IF(cond,\
+		"[%s: %s: %d] "fmt, FAVORITES_FILE, __FUNCTION__, __LINE__, ##args); \
+}while(0)
+
+/**********************************************
+ * Trace event macro
+ **********************************************/
+/* Times the code between BEGIN and END into an event of the calling
+ * thread's ring, when the level is enabled. */
+#define FAVORITES_TRACE_BEGIN(_level_, _start_) \
+	unsigned long long _start_ = FAVORITES_TRACE_ON(_level_) ? _favorites_trace_now() : 0
+#define FAVORITES_TRACE_END(_start_, _phase_, _rows_) do { \
+	if (_start_) \
+		_favorites_trace_event(__FUNCTION__, _phase_, _start_, _rows_); \
+}while(0)
+
+/**********************************************
+ * Public API entry macro
+ **********************************************/
+/* Names the public function the calling thread is in, the outermost one
+ * when they nest, until it returns. The connections its helpers open are
+ * accounted to that name in the lock-wait statistics. */
+extern __thread const char *gl_favorites_api;
+void _favorites_api_leave(const char **saved);
+#define FAVORITES_API_ENTER() \
+	const char *_favorites_api_saved __attribute__((cleanup(_favorites_api_leave))) = \
+		gl_favorites_api; \
+	if (gl_favorites_api == NULL) \
+		gl_favorites_api = __FUNCTION__
+#define FAVORITES_API_NAME	(gl_favorites_api ? gl_favorites_api : __FUNCTION__)
 
 /**********************************************
  * Argument checking macro
@@ -59,6 +104,14 @@ extern "C" {
     } \
 }while(0)
 
+#define FAVORITES_WRITABLE_CHECK()	do { \
+	if(_favorites_db_is_read_only()) { \
+        LOGE("[%s] FAVORITES_ERROR_READ_ONLY(0x%08x)", __FUNCTION__,\
+        FAVORITES_ERROR_READ_ONLY); \
+        return FAVORITES_ERROR_READ_ONLY; \
+    } \
+}while(0)
+
 #define _FAVORITES_FREE(_srcx_) 	{	if(NULL != _srcx_) free(_srcx_);	}
 #define _FAVORITES_STRDUP(_srcx_) 	(NULL != _srcx_) ? strdup(_srcx_):NULL
 
@@ -93,7 +146,7 @@ typedef struct bookmark_list bookmark_list_s;
 typedef struct bookmark_list *bookmark_list_h;
 
 struct favicon_entry {
-	void *data;	/* favicon image data pointer. ( Allocated memory) */
+	void *data;	/* favicon image data pointer. ( Allocated memory, shared with Evas) */
 	int length;	/* favicon image data's length */
 	int w;		/* favicon image width */
 	int h;		/* favicon image height */
@@ -101,17 +154,39 @@ struct favicon_entry {
 typedef struct favicon_entry favicon_entry_s;
 typedef struct favicon_entry *favicon_entry_h;
 
+struct favorites_db_column {
+	const char *table;
+	const char *column;
+	const char *decl;	/* type and constraints for ALTER TABLE ADD COLUMN */
+};
+typedef struct favorites_db_column favorites_db_column_s;
+
+/* common db internal API */
+int _favorites_db_is_read_only(void);
+int _favorites_db_open(const char *path, sqlite3 **db);
+int _favorites_db_exec(sqlite3 *db, const char *sql);
+int _favorites_db_column_exists(sqlite3 *db, const char *table, const char *column);
+int _favorites_db_add_column(sqlite3 *db, const char *table, const char *column, const char *decl);
+int _favorites_db_upgrade(sqlite3 *db, const favorites_db_column_s *columns,
+		const char **schema, int version, const char **backfill);
+sqlite3_int64 _favorites_db_url_hash(const char *url);
+int _favorites_db_register_functions(sqlite3 *db);
+void _favorites_db_set_busy_handler(sqlite3 *db, const char *api);
+
 /* bookmark internal API */
 void _favorites_close_bookmark_db(void);
 void _favorites_finalize_bookmark_db(sqlite3_stmt *stmt);
 const char *_favorites_get_bookmark_db_name(void);
-int _favorites_open_bookmark_db(void);
+int _favorites_open_bookmark_db_at(const char *api);
+/* the api of the lock-wait statistics is the public function being called */
+#define _favorites_open_bookmark_db() _favorites_open_bookmark_db_at(FAVORITES_API_NAME)
+void _favorites_bookmark_db_schema_changed(void);
 void _favorites_free_bookmark_list(bookmark_list_h m_list);
 int _favorites_free_bookmark_entry(favorites_bookmark_entry_s *entry);
 int _favorites_get_bookmark_lastindex(int locationId);
 int _favorites_bookmark_get_folderID(const char *foldername);
 int _favorites_bookmark_is_folder_exist(const char *foldername);
-int _favorites_bookmark_create_folder(const char *foldername);
+int _favorites_bookmark_create_folder(const char *foldername, int parent_id);
 int _favorites_bookmark_is_bookmark_exist(const char *url, const char *title, const int folderId);
 int _favorites_get_bookmark_count_at_folder(int folderId);
 int _favorites_bookmark_get_folder_count(void);
@@ -119,12 +194,50 @@ bookmark_list_h _favorites_get_bookmark_list_at_folder(int folderId);
 bookmark_list_h _favorites_bookmark_get_folder_list(void);
 int _favorites_get_unixtime_from_datetime(char *datetime);
 int _favorites_bookmark_get_bookmark_id(const char *url, const char *title, const int folder_id);
+int _favorites_bookmark_get_meta(const char *name, sqlite3_int64 *value);
+
+/* bookmark read cache internal API */
+bookmark_list_h _favorites_bookmark_cache_acquire(void);
+void _favorites_bookmark_cache_release(bookmark_list_h list);
+void _favorites_bookmark_cache_invalidate(void);
+int _favorites_bookmark_cache_count(bookmark_list_h list, int is_folder, int folder_id);
+bookmark_list_h _favorites_bookmark_cache_filter(bookmark_list_h list, int is_folder, int folder_id);
+int _favorites_bookmark_folder_cache_lookup(sqlite3_int64 version, int parent_id,
+		const char *title);
+void _favorites_bookmark_folder_cache_insert(sqlite3_int64 version, int parent_id,
+		const char *title, int id);
+void _favorites_bookmark_folder_cache_remove(int id);
+
+/* bookmark snapshot file internal API */
+void _favorites_bookmark_snapshot_refresh(void);
+
+/* favicon cache internal API */
+favicon_entry_h _favorites_favicon_cache_lookup(int id, int size);
+favicon_entry_h _favorites_favicon_cache_insert(int id, int size, const void *data, int length, int w, int h);
+favicon_entry_h _favorites_favicon_cache_insert_buffer(int id, int size, void *data, int length, int w, int h);
+void _favorites_favicon_cache_release(favicon_entry_h favicon);
+void _favorites_favicon_cache_invalidate(int id);
+Evas_Object *_favorites_favicon_cache_create_image(favicon_entry_h favicon, Evas *evas);
+int _favorites_favicon_scale(const void *src, int sw, int sh, void *dst, int dw, int dh);
 
 /* history internal API */
 void _favorites_history_db_close(void);
 void _favorites_history_db_finalize(sqlite3_stmt *stmt);
-int _favorites_history_db_open(void);
+int _favorites_history_db_open_at(const char *api);
+#define _favorites_history_db_open() _favorites_history_db_open_at(FAVORITES_API_NAME)
+void _favorites_history_db_schema_changed(void);
 int _favorites_free_history_entry(favorites_history_entry_s *entry);
+int _favorites_history_flush_visits(void);
+void _favorites_history_foreach_visit_hash(void (*callback)(sqlite3_int64 url_hash));
+int _favorites_history_get_meta(const char *name, sqlite3_int64 *value);
+
+/* trace internal API */
+unsigned long long _favorites_trace_now(void);
+void _favorites_trace_event(const char *api, const char *phase, unsigned long long start, int rows);
+
+/* url filter internal API */
+void _favorites_url_filter_add(sqlite3_int64 url_hash);
+void _favorites_url_filter_invalidate(void);
 
 #ifdef __cplusplus
 };
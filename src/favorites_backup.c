@@ -0,0 +1,275 @@
+/*
+ * Copyright (c) 2011 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <dlog.h>
+#include <db-util.h>
+#include <favorites.h>
+#include <favorites_private.h>
+
+extern __thread sqlite3 *gl_internet_bookmark_db;
+extern __thread sqlite3 *gl_internet_history_db;
+
+/* file names of the databases in a backup directory */
+#define BACKUP_BOOKMARK_FILE	"bookmark.db"
+#define BACKUP_HISTORY_FILE	"history.db"
+
+/* pause between two steps, so that the writers waiting for the lock get it */
+#define BACKUP_STEP_PAUSE_MS	5
+/* a copy kept restarting by the writers, or kept waiting for the lock, fails */
+#define BACKUP_MAX_RESTARTS	16
+#define BACKUP_MAX_BUSY_STEPS	100	/* in a row */
+
+struct backup_progress {
+	favorites_backup_progress_cb callback;
+	void *user_data;
+	int copied;	/* pages of the databases already done */
+	int total;
+};
+typedef struct backup_progress backup_progress_s;
+
+/*
+ * Copies src into dst, pages_per_step pages at a time. The source is only
+ * locked during a step; if another connection writes to it in between,
+ * sqlite restarts the copy. Returns 0, 1 if cancelled or -1, also when
+ * the restarts or the busy steps exceed their limit.
+ */
+static int _favorites_backup_copy(sqlite3 *dst, sqlite3 *src, int pages_per_step,
+		backup_progress_s *progress)
+{
+	sqlite3_backup *backup;
+	int nError;
+	int pages = 0;
+	int remaining = -1;
+	int restarts = 0;
+	int busy_steps = 0;
+	int cancelled = 0;
+	int failed = 0;
+
+	backup = sqlite3_backup_init(dst, "main", src, "main");
+	if (backup == NULL) {
+		FAVORITES_LOGE("sqlite3_backup_init is failed(%s).\n", sqlite3_errmsg(dst));
+		return -1;
+	}
+	do {
+		nError = sqlite3_backup_step(backup, pages_per_step);
+		pages = sqlite3_backup_pagecount(backup);
+		if (nError == SQLITE_OK || nError == SQLITE_BUSY || nError == SQLITE_LOCKED) {
+			/* a step which copied pages without lowering the remaining
+			 * ones started the copy over */
+			if (nError == SQLITE_OK && remaining >= 0
+					&& sqlite3_backup_remaining(backup) >= remaining
+					&& ++restarts > BACKUP_MAX_RESTARTS) {
+				FAVORITES_LOGE("the copy restarted %d times\n", restarts);
+				failed = 1;
+				break;
+			}
+			remaining = sqlite3_backup_remaining(backup);
+			busy_steps = nError == SQLITE_OK ? 0 : busy_steps + 1;
+			if (busy_steps > BACKUP_MAX_BUSY_STEPS) {
+				FAVORITES_LOGE("the database stayed locked for %d steps\n", busy_steps);
+				failed = 1;
+				break;
+			}
+			if (progress->callback != NULL && !progress->callback(
+					progress->copied + pages - remaining,
+					progress->total, progress->user_data)) {
+				cancelled = 1;
+				break;
+			}
+			sqlite3_sleep(BACKUP_STEP_PAUSE_MS);
+		}
+	} while (nError == SQLITE_OK || nError == SQLITE_BUSY || nError == SQLITE_LOCKED);
+
+	if (sqlite3_backup_finish(backup) != SQLITE_OK && !cancelled && !failed) {
+		FAVORITES_LOGE("sqlite3_backup_step is failed(%s).\n", sqlite3_errmsg(dst));
+		return -1;
+	}
+	if (failed)
+		return -1;
+	if (cancelled)
+		return 1;
+	progress->copied += pages;
+	/* the last step is reported too, the copy being done whatever it returns */
+	if (progress->callback != NULL)
+		progress->callback(progress->copied, progress->total, progress->user_data);
+	return 0;
+}
+
+static int _favorites_backup_page_count(sqlite3 *db)
+{
+	sqlite3_stmt *stmt;
+	int count = 0;
+
+	if (sqlite3_prepare_v2(db, "pragma page_count", -1, &stmt, NULL) == SQLITE_OK
+			&& sqlite3_step(stmt) == SQLITE_ROW)
+		count = sqlite3_column_int(stmt, 0);
+	sqlite3_finalize(stmt);
+	return count;
+}
+
+/* Copies between a live database, opened with the given functions on
+ * behalf of api, and a file. to_file tells the direction. */
+static int _favorites_backup_run(int (*open_db)(const char *), void (*close_db)(void),
+		sqlite3 **live, const char *path, int to_file, int pages_per_step,
+		backup_progress_s *progress, const char *api)
+{
+	sqlite3 *file = NULL;
+	int ret;
+	int flags = to_file ? SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE
+		: SQLITE_OPEN_READONLY;
+
+	if (sqlite3_open_v2(path, &file, flags, NULL) != SQLITE_OK) {
+		FAVORITES_LOGE("sqlite3_open_v2 is failed(%s)\n", path);
+		sqlite3_close(file);
+		return -1;
+	}
+	if (open_db(api) < 0) {
+		FAVORITES_LOGE("db_util_open is failed\n");
+		sqlite3_close(file);
+		return -1;
+	}
+	if (to_file)
+		ret = _favorites_backup_copy(file, *live, pages_per_step, progress);
+	else
+		ret = _favorites_backup_copy(*live, file, pages_per_step, progress);
+	close_db();
+	sqlite3_close(file);
+	return ret;
+}
+
+static int _favorites_backup_path(char *path, int size, const char *dir, const char *file)
+{
+	if (snprintf(path, size, "%s/%s", dir, file) >= size) {
+		FAVORITES_LOGE("path is too long\n");
+		return -1;
+	}
+	return 0;
+}
+
+/* Pages of a backup file, for the progress report of a restore */
+static int _favorites_backup_file_page_count(const char *path)
+{
+	sqlite3 *file = NULL;
+	int count = 0;
+
+	if (sqlite3_open_v2(path, &file, SQLITE_OPEN_READONLY, NULL) == SQLITE_OK)
+		count = _favorites_backup_page_count(file);
+	else
+		FAVORITES_LOGE("sqlite3_open_v2 is failed(%s)\n", path);
+	sqlite3_close(file);
+	return count;
+}
+
+/* Sums the pages of both live databases, for the progress report of a backup */
+static int _favorites_backup_total_pages(void)
+{
+	int total = 0;
+
+	if (_favorites_open_bookmark_db() == 0)
+		total += _favorites_backup_page_count(gl_internet_bookmark_db);
+	_favorites_close_bookmark_db();
+	if (_favorites_history_db_open() == 0)
+		total += _favorites_backup_page_count(gl_internet_history_db);
+	_favorites_history_db_close();
+	return total;
+}
+
+/*************************************************************
+ *	APIs for Internet favorites
+ *************************************************************/
+int favorites_backup(const char *dest_path, int pages_per_step,
+		favorites_backup_progress_cb callback, void *user_data)
+{
+	FAVORITES_API_ENTER();
+	FAVORITES_NULL_ARG_CHECK(dest_path);
+	FAVORITES_INVALID_ARG_CHECK(pages_per_step<=0);
+	char	bookmark_path[1024];
+	char	history_path[1024];
+	backup_progress_s progress = { callback, user_data, 0, 0 };
+	int ret;
+
+	if (_favorites_backup_path(bookmark_path, sizeof(bookmark_path),
+				dest_path, BACKUP_BOOKMARK_FILE) < 0
+			|| _favorites_backup_path(history_path, sizeof(history_path),
+				dest_path, BACKUP_HISTORY_FILE) < 0)
+		return FAVORITES_ERROR_INVALID_PARAMETER;
+
+	/* buffered visits are part of the history to save */
+	_favorites_history_flush_visits();
+	progress.total = _favorites_backup_total_pages();
+
+	ret = _favorites_backup_run(_favorites_open_bookmark_db_at, _favorites_close_bookmark_db,
+			&gl_internet_bookmark_db, bookmark_path, 1, pages_per_step, &progress,
+			FAVORITES_API_NAME);
+	if (ret == 0)
+		ret = _favorites_backup_run(_favorites_history_db_open_at, _favorites_history_db_close,
+				&gl_internet_history_db, history_path, 1, pages_per_step, &progress,
+				FAVORITES_API_NAME);
+	if (ret < 0)
+		return FAVORITES_ERROR_DB_FAILED;
+	return FAVORITES_ERROR_NONE;
+}
+
+int favorites_restore(const char *src_path, int pages_per_step,
+		favorites_backup_progress_cb callback, void *user_data)
+{
+	FAVORITES_API_ENTER();
+	FAVORITES_WRITABLE_CHECK();
+	FAVORITES_NULL_ARG_CHECK(src_path);
+	FAVORITES_INVALID_ARG_CHECK(pages_per_step<=0);
+	char	bookmark_path[1024];
+	char	history_path[1024];
+	backup_progress_s progress = { callback, user_data, 0, 0 };
+	int ret;
+
+	if (_favorites_backup_path(bookmark_path, sizeof(bookmark_path),
+				src_path, BACKUP_BOOKMARK_FILE) < 0
+			|| _favorites_backup_path(history_path, sizeof(history_path),
+				src_path, BACKUP_HISTORY_FILE) < 0)
+		return FAVORITES_ERROR_INVALID_PARAMETER;
+	/* do not restore one database out of two */
+	if (access(bookmark_path, R_OK) != 0 || access(history_path, R_OK) != 0) {
+		FAVORITES_LOGE("backup files are missing in %s\n", src_path);
+		return FAVORITES_ERROR_INVALID_PARAMETER;
+	}
+
+	_favorites_history_flush_visits();
+	/* the restore copies the pages of the backup, not of the live databases */
+	progress.total = _favorites_backup_file_page_count(bookmark_path)
+		+ _favorites_backup_file_page_count(history_path);
+
+	ret = _favorites_backup_run(_favorites_open_bookmark_db_at, _favorites_close_bookmark_db,
+			&gl_internet_bookmark_db, bookmark_path, 0, pages_per_step, &progress,
+			FAVORITES_API_NAME);
+	/* the restored files may predate the schema upgrades */
+	_favorites_bookmark_db_schema_changed();
+	_favorites_bookmark_cache_invalidate();
+	_favorites_bookmark_folder_cache_remove(-1);
+	_favorites_favicon_cache_invalidate(-1);
+	_favorites_url_filter_invalidate();
+	if (ret == 0) {
+		ret = _favorites_backup_run(_favorites_history_db_open_at, _favorites_history_db_close,
+				&gl_internet_history_db, history_path, 0, pages_per_step, &progress,
+				FAVORITES_API_NAME);
+		_favorites_history_db_schema_changed();
+		_favorites_url_filter_invalidate();
+	}
+	if (ret < 0)
+		return FAVORITES_ERROR_DB_FAILED;
+	return FAVORITES_ERROR_NONE;
+}
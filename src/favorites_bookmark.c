@@ -15,18 +15,27 @@
  */
 
 #include <string.h>
+#include <pthread.h>
 #include <dlog.h>
 #include <db-util.h>
 #include <favorites.h>
 #include <favorites_private.h>
 
 __thread sqlite3 *gl_internet_bookmark_db = 0;
+/* the connection of this thread is traced from open to close */
+static __thread unsigned long long gl_bookmark_db_trace_start = 0;
+static __thread const char *gl_bookmark_db_trace_api = NULL;
 
 /* Private Functions */
 void _favorites_close_bookmark_db(void)
 {
 	if (gl_internet_bookmark_db) {
 		/* ASSERT(currentThread() == m_openingThread); */
+		if (gl_bookmark_db_trace_start) {
+			_favorites_trace_event(gl_bookmark_db_trace_api, "bookmark db",
+					gl_bookmark_db_trace_start, sqlite3_total_changes(gl_internet_bookmark_db));
+			gl_bookmark_db_trace_start = 0;
+		}
 		db_util_close(gl_internet_bookmark_db);
 		gl_internet_bookmark_db = 0;
 	}
@@ -43,22 +52,239 @@ const char *_favorites_get_bookmark_db_name(void)
 {
 	return "/opt/dbspace/.internet_bookmark.db";
 }
-int _favorites_open_bookmark_db(void)
+
+/* Schema additions owned by this library. They are applied, together with
+ * the one-time rebuilds they need, when the db is older than
+ * BOOKMARK_DB_SCHEMA_VERSION, which must be raised whenever they change.
+ * The backfill runs on the first open of every process and must only
+ * reach the rows it updates through an index. */
+#define BOOKMARK_DB_SCHEMA_VERSION	2
+
+static const favorites_db_column_s gl_bookmark_db_columns[] = {
+	/* reference into favicons, see favorites_bookmark_deduplicate_favicons() */
+	{ "bookmarks", "favicon_id", "integer" },
+	/* _favorites_db_url_hash() of address, NULL until computed */
+	{ "bookmarks", "url_hash", "integer" },
+	{ NULL, NULL, NULL }
+};
+static const char *gl_bookmark_db_schema[] = {
+	"create table if not exists favorites_meta\
+		(name text primary key, value integer not null)",
+	/* bookmarks_version is bumped on every change of the bookmarks table,
+	 * whichever process makes it. It is what the read cache validates against. */
+	"insert or ignore into favorites_meta values('bookmarks_version', 0)",
+	"create trigger if not exists favorites_bookmarks_version_insert\
+		after insert on bookmarks begin\
+		update favorites_meta set value=value+1 where name='bookmarks_version'; end",
+	"create trigger if not exists favorites_bookmarks_version_update\
+		after update on bookmarks begin\
+		update favorites_meta set value=value+1 where name='bookmarks_version'; end",
+	"create trigger if not exists favorites_bookmarks_version_delete\
+		after delete on bookmarks begin\
+		update favorites_meta set value=value+1 where name='bookmarks_version'; end",
+	/* folders_version only moves when a folder is added, removed or renamed,
+	 * it guards the folder name cache */
+	"insert or ignore into favorites_meta values('folders_version', 0)",
+	"create trigger if not exists favorites_folders_version_insert\
+		after insert on bookmarks when new.type=1 begin\
+		update favorites_meta set value=value+1 where name='folders_version'; end",
+	"create trigger if not exists favorites_folders_version_update\
+		after update of id, type, title on bookmarks when old.type=1 or new.type=1 begin\
+		update favorites_meta set value=value+1 where name='folders_version'; end",
+	"create trigger if not exists favorites_folders_version_delete\
+		after delete on bookmarks when old.type=1 begin\
+		update favorites_meta set value=value+1 where name='folders_version'; end",
+	"create trigger if not exists favorites_folders_version_move\
+		after update of parent on bookmarks when old.type=1 or new.type=1 begin\
+		update favorites_meta set value=value+1 where name='folders_version'; end",
+	"create index if not exists bookmarks_type_title_idx on bookmarks(type, title)",
+	/* items are listed and moved in (sequence, id) order within a folder */
+	"create index if not exists bookmarks_parent_sequence_idx on bookmarks(parent, sequence)",
+	/* url lookups go through url_hash. An address changed by the browser
+	 * keeps a stale hash, so it is reset and backfilled on a later upgrade. */
+	"create index if not exists bookmarks_url_hash_idx on bookmarks(url_hash)",
+	/* urls_version tells the url filter that addresses were added */
+	"insert or ignore into favorites_meta values('urls_version', 0)",
+	"create trigger if not exists favorites_urls_version_insert\
+		after insert on bookmarks when new.address is not null begin\
+		update favorites_meta set value=value+1 where name='urls_version'; end",
+	"create trigger if not exists favorites_urls_version_update\
+		after update of address on bookmarks when new.address is not old.address begin\
+		update favorites_meta set value=value+1 where name='urls_version'; end",
+	/* urls_changed only counts addresses changed in place, after which
+	 * the url filter is rebuilt rather than extended */
+	"insert or ignore into favorites_meta values('urls_changed', 0)",
+	"create trigger if not exists favorites_urls_changed_update\
+		after update of address on bookmarks when new.address is not old.address begin\
+		update favorites_meta set value=value+1 where name='urls_changed'; end",
+	"create trigger if not exists favorites_bookmarks_url_hash_update\
+		after update of address on bookmarks when new.url_hash is old.url_hash begin\
+		update bookmarks set url_hash=null where id=new.id; end",
+	/* Item counts answered without a scan: bookmarks_count and
+	 * folders_count over the whole tree, favorites_folder_counts per
+	 * parent. They are recounted here, along with the creation of the
+	 * triggers, for the rows written before. */
+	"create table if not exists favorites_folder_counts\
+		(folder_id integer primary key, bookmarks integer not null default 0,\
+		folders integer not null default 0)",
+	"insert or ignore into favorites_meta values('bookmarks_count', 0)",
+	"insert or ignore into favorites_meta values('folders_count', 0)",
+	"update favorites_meta set value=(select count(*) from bookmarks where parent != 0)\
+		where name='bookmarks_count'",
+	"update favorites_meta set value=(select count(*) from bookmarks\
+		where type=1 and parent != 0) where name='folders_count'",
+	"delete from favorites_folder_counts",
+	"insert into favorites_folder_counts(folder_id, bookmarks, folders)\
+		select parent, sum(type=0), sum(type=1) from bookmarks group by parent",
+	"create trigger if not exists favorites_counts_insert\
+		after insert on bookmarks begin\
+		update favorites_meta set value=value+(new.parent != 0) where name='bookmarks_count';\
+		update favorites_meta set value=value+(new.type=1 and new.parent != 0)\
+			where name='folders_count';\
+		insert or ignore into favorites_folder_counts(folder_id) values(new.parent);\
+		update favorites_folder_counts set bookmarks=bookmarks+(new.type=0),\
+			folders=folders+(new.type=1) where folder_id=new.parent; end",
+	"create trigger if not exists favorites_counts_update\
+		after update of type, parent on bookmarks\
+		when old.type is not new.type or old.parent is not new.parent begin\
+		update favorites_meta set value=value+(new.parent != 0)-(old.parent != 0)\
+			where name='bookmarks_count';\
+		update favorites_meta set value=value+(new.type=1 and new.parent != 0)\
+			-(old.type=1 and old.parent != 0) where name='folders_count';\
+		update favorites_folder_counts set bookmarks=bookmarks-(old.type=0),\
+			folders=folders-(old.type=1) where folder_id=old.parent;\
+		insert or ignore into favorites_folder_counts(folder_id) values(new.parent);\
+		update favorites_folder_counts set bookmarks=bookmarks+(new.type=0),\
+			folders=folders+(new.type=1) where folder_id=new.parent; end",
+	"create trigger if not exists favorites_counts_delete\
+		after delete on bookmarks begin\
+		update favorites_meta set value=value-(old.parent != 0) where name='bookmarks_count';\
+		update favorites_meta set value=value-(old.type=1 and old.parent != 0)\
+			where name='folders_count';\
+		update favorites_folder_counts set bookmarks=bookmarks-(old.type=0),\
+			folders=folders-(old.type=1) where folder_id=old.parent;\
+		delete from favorites_folder_counts where folder_id=old.id; end",
+	/* Content-addressed favicons shared by bookmarks. hash is not unique,
+	 * equal hashes are told apart by comparing the data. refcount is kept by
+	 * the triggers below, and a favicon goes away with its last reference. */
+	"create table if not exists favicons\
+		(id integer primary key, hash integer not null, data blob,\
+		length integer, w integer, h integer, refcount integer not null default 0)",
+	"create index if not exists favicons_hash_idx on favicons(hash)",
+	"create trigger if not exists favorites_favicons_ref_insert\
+		after insert on bookmarks when new.favicon_id is not null begin\
+		update favicons set refcount=refcount+1 where id=new.favicon_id; end",
+	"create trigger if not exists favorites_favicons_ref_update\
+		after update of favicon_id on bookmarks\
+		when old.favicon_id is not new.favicon_id begin\
+		update favicons set refcount=refcount+1 where id=new.favicon_id;\
+		update favicons set refcount=refcount-1 where id=old.favicon_id;\
+		delete from favicons where id=old.favicon_id and refcount<=0; end",
+	"create trigger if not exists favorites_favicons_ref_delete\
+		after delete on bookmarks when old.favicon_id is not null begin\
+		update favicons set refcount=refcount-1 where id=old.favicon_id;\
+		delete from favicons where id=old.favicon_id and refcount<=0; end",
+	/* downscaled copies of a favicon, see gl_favicon_variant_sizes */
+	"create table if not exists favicon_variants\
+		(id integer primary key, favicon_id integer not null, size integer not null,\
+		data blob, length integer, w integer, h integer)",
+	"create unique index if not exists favicon_variants_idx\
+		on favicon_variants(favicon_id, size)",
+	"create trigger if not exists favorites_favicon_variants_delete\
+		after delete on favicons begin\
+		delete from favicon_variants where favicon_id=old.id; end",
+	NULL
+};
+static const char *gl_bookmark_db_backfill[] = {
+	/* the browser does not have favorites_url_hash(), its rows get their
+	 * hash here; bookmarks_url_hash_idx finds them */
+	"update bookmarks set url_hash=favorites_url_hash(address)\
+		where url_hash is null and address is not null",
+	NULL
+};
+/*
+ * New items are appended BOOKMARK_SEQUENCE_GAP after the last one, so an
+ * item moved between two others usually fits in between without touching
+ * them. When there is no room left, the following items are spread again,
+ * as few of them as gives every one at least BOOKMARK_SEQUENCE_MIN_GAP.
+ */
+#define BOOKMARK_SEQUENCE_GAP		1024
+#define BOOKMARK_SEQUENCE_MIN_GAP	(BOOKMARK_SEQUENCE_GAP / 8)
+
+/* folders nested deeper are not walked, this also stops on a parent cycle
+ * written by another process */
+#define BOOKMARK_TREE_MAX_DEPTH		64
+
+static pthread_mutex_t gl_bookmark_db_upgrade_lock = PTHREAD_MUTEX_INITIALIZER;
+static int gl_bookmark_db_upgraded = 0;
+
+/* The db file was replaced, upgrade it again on the next open */
+void _favorites_bookmark_db_schema_changed(void)
+{
+	pthread_mutex_lock(&gl_bookmark_db_upgrade_lock);
+	gl_bookmark_db_upgraded = 0;
+	pthread_mutex_unlock(&gl_bookmark_db_upgrade_lock);
+}
+
+int _favorites_open_bookmark_db_at(const char *api)
 {
 	_favorites_close_bookmark_db();
-	if (db_util_open
-	    (_favorites_get_bookmark_db_name(), &gl_internet_bookmark_db,
-	     DB_UTIL_REGISTER_HOOK_METHOD) != SQLITE_OK) {
+	gl_bookmark_db_trace_start = FAVORITES_TRACE_ON(FAVORITES_TRACE_LEVEL_INFO)
+		? _favorites_trace_now() : 0;
+	gl_bookmark_db_trace_api = api;
+	if (_favorites_db_open
+	    (_favorites_get_bookmark_db_name(), &gl_internet_bookmark_db) != SQLITE_OK) {
 		db_util_close(gl_internet_bookmark_db);
 		gl_internet_bookmark_db = 0;
 		return -1;
 	}
-	return gl_internet_bookmark_db ? 0 : -1;
+	if (!gl_internet_bookmark_db)
+		return -1;
+	if (_favorites_db_register_functions(gl_internet_bookmark_db) < 0)
+		return -1;
+	_favorites_db_set_busy_handler(gl_internet_bookmark_db, api);
+
+	pthread_mutex_lock(&gl_bookmark_db_upgrade_lock);
+	if (!gl_bookmark_db_upgraded && !_favorites_db_is_read_only()) {
+		/* A failed upgrade is retried on the next open; until then only
+		 * the features relying on it are unavailable. */
+		if (_favorites_db_upgrade(gl_internet_bookmark_db,
+				gl_bookmark_db_columns, gl_bookmark_db_schema,
+				BOOKMARK_DB_SCHEMA_VERSION, gl_bookmark_db_backfill) == 0)
+			gl_bookmark_db_upgraded = 1;
+	}
+	pthread_mutex_unlock(&gl_bookmark_db_upgrade_lock);
+	return 0;
+}
+
+/* Reads one of the favorites_meta values on the opened db */
+int _favorites_bookmark_get_meta(const char *name, sqlite3_int64 *value)
+{
+	int nError;
+	sqlite3_stmt *stmt;
+
+	nError = sqlite3_prepare_v2(gl_internet_bookmark_db,
+			"select value from favorites_meta where name=?",
+			-1, &stmt, NULL);
+	if (nError != SQLITE_OK) {
+		FAVORITES_LOGE("sqlite3_prepare_v2 is failed.\n");
+		sqlite3_finalize(stmt);
+		return -1;
+	}
+	sqlite3_bind_text(stmt, 1, name, -1, NULL);
+	nError = sqlite3_step(stmt);
+	if (nError != SQLITE_ROW) {
+		sqlite3_finalize(stmt);
+		return -1;
+	}
+	*value = sqlite3_column_int64(stmt, 0);
+	sqlite3_finalize(stmt);
+	return 0;
 }
 
 void _favorites_free_bookmark_list(bookmark_list_h m_list)
 {
-	FAVORITES_LOGE(" ");
+	FAVORITES_LOGD(" ");
 
 	int i = 0;
 	if (m_list == NULL)
@@ -97,221 +323,296 @@ int _favorites_free_bookmark_entry(favorites_bookmark_entry_s *entry)
 	return FAVORITES_ERROR_NONE;
 }
 
-/* search last of sequence(order's index) */
-int _favorites_get_bookmark_lastindex(int locationId)
+/* Sequence for an item appended to the folder on the opened db, leaving
+ * a gap after the last item. exclude_id is left out of the search. */
+static int _favorites_bookmark_next_sequence(int locationId, int exclude_id)
 {
 	int nError;
+	int index = -1;
 	sqlite3_stmt *stmt;
 
-	if (_favorites_open_bookmark_db() < 0) {
-		FAVORITES_LOGE("db_util_open is failed\n");
-		return -1;
-	}
-
 	nError =
 	    sqlite3_prepare_v2(gl_internet_bookmark_db,
-			       "select sequence from bookmarks where parent=? order by sequence desc",
+			       "select max(sequence) from bookmarks where parent=? and id!=?",
 			       -1, &stmt, NULL);
 	if (nError != SQLITE_OK) {
 		FAVORITES_LOGE("sqlite3_prepare_v2 is failed");
-		_favorites_finalize_bookmark_db(stmt);
+		sqlite3_finalize(stmt);
 		return -1;
 	}
-	if (sqlite3_bind_int(stmt, 1, locationId) != SQLITE_OK) {
+	if (sqlite3_bind_int(stmt, 1, locationId) != SQLITE_OK
+			|| sqlite3_bind_int(stmt, 2, exclude_id) != SQLITE_OK) {
 		FAVORITES_LOGE("sqlite3_bind_int is failed");
-		_favorites_finalize_bookmark_db(stmt);
+		sqlite3_finalize(stmt);
 		return -1;
 	}
 
 	if ((nError = sqlite3_step(stmt)) == SQLITE_ROW) {
-		int index = sqlite3_column_int(stmt, 0);
-		_favorites_finalize_bookmark_db(stmt);
-		return index;
+		if (sqlite3_column_type(stmt, 0) == SQLITE_NULL) {
+			FAVORITES_LOGD("Not found items in This Folder");
+			index = BOOKMARK_SEQUENCE_GAP;
+		} else {
+			index = sqlite3_column_int(stmt, 0) + BOOKMARK_SEQUENCE_GAP;
+		}
 	}
-	FAVORITES_LOGE("Not found items in This Folder");
-	_favorites_close_bookmark_db();
-	return 0;
+	sqlite3_finalize(stmt);
+	return index;
 }
 
-int _favorites_bookmark_get_folderID(const char *foldername)
+/* search the sequence(order's index) following the last one */
+int _favorites_get_bookmark_lastindex(int locationId)
 {
-	FAVORITES_LOGE("foldername: %s", foldername);
-	int nError;
-	sqlite3_stmt *stmt;
-	char	query[1024];
-
-	memset(&query, 0x00, sizeof(char)*1024);
-
-	/* If there is no identical folder name, create new folder */
-	if (_favorites_bookmark_is_folder_exist(foldername)==0){
-		if(_favorites_bookmark_create_folder(foldername)!=1){
-			FAVORITES_LOGE("folder creating is failed.");
-			return -1;
-		}
-	}
+	int index;
 
 	if (_favorites_open_bookmark_db() < 0) {
 		FAVORITES_LOGE("db_util_open is failed\n");
 		return -1;
 	}
+	index = _favorites_bookmark_next_sequence(locationId, 0);
+	_favorites_close_bookmark_db();
+	return index;
+}
 
-	sprintf(query, "select id from bookmarks where type=1 AND title='%s'"
-			, foldername);
-
-	/* check foldername in the bookmark table */
-	nError = sqlite3_prepare_v2(gl_internet_bookmark_db,query
-				,-1, &stmt, NULL);
+/* Looks the folder up by name among the folders of parent_id on the
+ * opened db, 0 if there is none */
+static int _favorites_bookmark_find_folder(const char *foldername, int parent_id)
+{
+	int nError;
+	int folderId = 0;
+	sqlite3_stmt *stmt;
 
+	nError = sqlite3_prepare_v2(gl_internet_bookmark_db,
+			"select id from bookmarks where type=1 AND parent=? AND title=?",
+			-1, &stmt, NULL);
 	if (nError != SQLITE_OK) {
 		FAVORITES_LOGE("sqlite3_prepare_v2 is failed.\n");
-		_favorites_finalize_bookmark_db(stmt);
+		sqlite3_finalize(stmt);
 		return -1;
 	}
-
-	nError = sqlite3_step(stmt);
-	if (nError == SQLITE_ROW) {
-		int folderId = sqlite3_column_int(stmt, 0);
-		_favorites_finalize_bookmark_db(stmt);
-		return folderId;
+	if (sqlite3_bind_int(stmt, 1, parent_id) != SQLITE_OK
+			|| sqlite3_bind_text(stmt, 2, foldername, -1, NULL) != SQLITE_OK) {
+		FAVORITES_LOGE("sqlite3_bind is failed.\n");
+		sqlite3_finalize(stmt);
+		return -1;
 	}
-	_favorites_close_bookmark_db();
-	return 1;
+	nError = sqlite3_step(stmt);
+	if (nError == SQLITE_ROW)
+		folderId = sqlite3_column_int(stmt, 0);
+	else if (nError != SQLITE_DONE)
+		folderId = -1;
+	sqlite3_finalize(stmt);
+	return folderId;
 }
 
-int _favorites_bookmark_is_folder_exist(const char *foldername)
+/* Appends a folder to parent_id on the opened db, within the caller's
+ * transaction. Returns the new id or -1. */
+static int _favorites_bookmark_insert_folder(const char *foldername, int parent_id)
 {
-	FAVORITES_LOGE("\n");
 	int nError;
+	int lastIndex;
 	sqlite3_stmt *stmt;
-	char	query[1024];
 
-	memset(&query, 0x00, sizeof(char)*1024);
+	if ((lastIndex = _favorites_bookmark_next_sequence(parent_id, 0)) < 0) {
+		FAVORITES_LOGE("Database::getLastIndex() is failed.\n");
+		return -1;
+	}
 
-	if (!foldername || (strlen(foldername) <= 0)) {
-		FAVORITES_LOGE("foldername is empty\n");
+	nError = sqlite3_prepare_v2(gl_internet_bookmark_db,
+			"insert into bookmarks\
+			(type, parent, title, creationdate, sequence, updatedate, editable)\
+			values (1, ?, ?, DATETIME('now'), ?, DATETIME('now'), 1)",
+			-1, &stmt, NULL);
+	if (nError != SQLITE_OK) {
+		FAVORITES_LOGE("sqlite3_prepare_v2 is failed(%s).\n",
+			sqlite3_errmsg(gl_internet_bookmark_db));
+		sqlite3_finalize(stmt);
+		return -1;
+	}
+	if (sqlite3_bind_int(stmt, 1, parent_id) != SQLITE_OK
+			|| sqlite3_bind_text(stmt, 2, foldername, -1, NULL) != SQLITE_OK
+			|| sqlite3_bind_int(stmt, 3, lastIndex) != SQLITE_OK) {
+		FAVORITES_LOGE("sqlite3_bind is failed.\n");
+		sqlite3_finalize(stmt);
+		return -1;
+	}
+	nError = sqlite3_step(stmt);
+	sqlite3_finalize(stmt);
+	if (nError != SQLITE_DONE) {
+		FAVORITES_LOGE("sqlite3_step is failed");
 		return -1;
 	}
-	FAVORITES_LOGE("foldername: %s", foldername);
+	return (int)sqlite3_last_insert_rowid(gl_internet_bookmark_db);
+}
+
+/* Looks a folder of the root up by name on the opened db, 0 if there is
+ * none. A cache hit costs the read of folders_version, which is what
+ * tells about folders changed by other processes. */
+static int _favorites_bookmark_lookup_folder(const char *foldername)
+{
+	FAVORITES_LOGD("foldername: %s", foldername);
+	int folderId;
+	sqlite3_int64 version = -1;
+	FAVORITES_TRACE_BEGIN(FAVORITES_TRACE_LEVEL_DEBUG, trace_start);
+
+	if (_favorites_bookmark_get_meta("folders_version", &version) == 0) {
+		folderId = _favorites_bookmark_folder_cache_lookup(version, 1, foldername);
+		if (folderId > 0) {
+			FAVORITES_TRACE_END(trace_start, "folder cache hit", 1);
+			return folderId;
+		}
+	}
+
+	folderId = _favorites_bookmark_find_folder(foldername, 1);
+	FAVORITES_TRACE_END(trace_start, "folder lookup", folderId > 0);
+	if (folderId > 0 && version >= 0)
+		_favorites_bookmark_folder_cache_insert(version, 1, foldername, folderId);
+	return folderId;
+}
+
+int _favorites_bookmark_get_folderID(const char *foldername)
+{
+	int folderId;
 
 	if (_favorites_open_bookmark_db() < 0) {
 		FAVORITES_LOGE("db_util_open is failed\n");
 		return -1;
 	}
+	folderId = _favorites_bookmark_lookup_folder(foldername);
+	_favorites_close_bookmark_db();
+	if (folderId < 0)
+		return -1;
 
-	sprintf(query, "select id from bookmarks where type=1 AND title='%s'"
-			, foldername);
+	/* If there is no identical folder name, create new folder */
+	if (folderId == 0) {
+		folderId = _favorites_bookmark_create_folder(foldername, 1);
+		if (folderId <= 0) {
+			FAVORITES_LOGE("folder creating is failed.");
+			return -1;
+		}
+	}
+	return folderId;
+}
 
-	/* check foldername in the bookmark table */
-	nError = sqlite3_prepare_v2(gl_internet_bookmark_db,query
-			       ,-1, &stmt, NULL);
+int _favorites_bookmark_is_folder_exist(const char *foldername)
+{
+	FAVORITES_LOGD("\n");
+	int folderId;
 
-	if (nError != SQLITE_OK) {
-		FAVORITES_LOGE("sqlite3_prepare_v2 is failed.\n");
-		_favorites_finalize_bookmark_db(stmt);
+	if (!foldername || (strlen(foldername) <= 0)) {
+		FAVORITES_LOGE("foldername is empty\n");
 		return -1;
 	}
+	FAVORITES_LOGD("foldername: %s", foldername);
 
-	nError = sqlite3_step(stmt);
-	if (nError == SQLITE_ROW) {
-		/* The given foldername is exist on the bookmark table */
-		_favorites_finalize_bookmark_db(stmt);
-		return 1;
+	if (_favorites_open_bookmark_db() < 0) {
+		FAVORITES_LOGE("db_util_open is failed\n");
+		return -1;
 	}
+
+	/* check foldername among the folders of the root */
+	folderId = _favorites_bookmark_find_folder(foldername, 1);
 	_favorites_close_bookmark_db();
-	return 0;
+	if (folderId < 0)
+		return -1;
+	return folderId > 0 ? 1 : 0;
 }
 
-int _favorites_bookmark_create_folder(const char *foldername)
+/* Returns the id of the folder named foldername in parent_id, created if
+ * there is none yet, or -1. The check and the insert are one transaction,
+ * so that concurrent callers end up with a single folder. */
+int _favorites_bookmark_create_folder(const char *foldername, int parent_id)
 {
-	FAVORITES_LOGE("\n");
-	int nError;
-	sqlite3_stmt *stmt;
-	char	query[1024];
-	int lastIndex = 0;
-
-	memset(&query, 0x00, sizeof(char)*1024);
+	FAVORITES_LOGD("\n");
+	int folderId;
 
 	if (!foldername || (strlen(foldername) <= 0)) {
 		FAVORITES_LOGE("foldername is empty\n");
 		return -1;
 	}
 
-	if ((lastIndex = _favorites_get_bookmark_lastindex(1)) < 0) {
-		FAVORITES_LOGE("Database::getLastIndex() is failed.\n");
-		return -1;
-	}
-
 	if (_favorites_open_bookmark_db() < 0) {
 		FAVORITES_LOGE("db_util_open is failed\n");
 		return -1;
 	}
+	if (_favorites_db_exec(gl_internet_bookmark_db, "begin immediate") < 0) {
+		_favorites_close_bookmark_db();
+		return -1;
+	}
 
-	sprintf(query, "insert into bookmarks \
-		(type, parent, title, creationdate, sequence, updatedate, editable)\
-		values (1, 1, '%s', DATETIME('now'), %d, DATETIME('now'), 1)"
-		, foldername, lastIndex);
+	folderId = _favorites_bookmark_find_folder(foldername, parent_id);
+	if (folderId == 0)
+		folderId = _favorites_bookmark_insert_folder(foldername, parent_id);
 
-	FAVORITES_LOGE("query:%s\n", query);
+	if (folderId < 0 || _favorites_db_exec(gl_internet_bookmark_db, "commit") < 0) {
+		sqlite3_exec(gl_internet_bookmark_db, "rollback", NULL, NULL, NULL);
+		folderId = -1;
+	}
+	_favorites_close_bookmark_db();
+	if (folderId > 0)
+		_favorites_bookmark_cache_invalidate();
+	return folderId;
+}
 
-	nError = sqlite3_prepare_v2(gl_internet_bookmark_db,
-			        query, -1, &stmt, NULL);
+/*
+ * Looks the bookmark up through the url_hash index. Rows the browser wrote
+ * since the last upgrade have no hash yet and are matched by address.
+ * Returns the id, 0 if there is none or -1.
+ */
+static int _favorites_bookmark_find_bookmark
+	(const char *url, const char *title, const int folderId)
+{
+	int nError;
+	int bookmark_id = 0;
+	sqlite3_stmt *stmt;
 
+	nError = sqlite3_prepare_v2(gl_internet_bookmark_db,
+			"select id from bookmarks where (url_hash=? or url_hash is null)\
+			AND type=0 AND address=? AND title=? AND parent=?",
+			-1, &stmt, NULL);
 	if (nError != SQLITE_OK) {
-		FAVORITES_LOGE("sqlite3_prepare_v2 is failed(%s).\n",
-			sqlite3_errmsg(gl_internet_bookmark_db));
-		_favorites_finalize_bookmark_db(stmt);
+		FAVORITES_LOGE("sqlite3_prepare_v2 is failed.\n");
+		sqlite3_finalize(stmt);
 		return -1;
 	}
-	
-	nError = sqlite3_step(stmt);
-	if (nError == SQLITE_OK || nError == SQLITE_DONE) {
-		_favorites_finalize_bookmark_db(stmt);
-		return 1;
+	if (sqlite3_bind_int64(stmt, 1, _favorites_db_url_hash(url)) != SQLITE_OK
+			|| sqlite3_bind_text(stmt, 2, url, -1, NULL) != SQLITE_OK
+			|| sqlite3_bind_text(stmt, 3, title, -1, NULL) != SQLITE_OK
+			|| sqlite3_bind_int(stmt, 4, folderId) != SQLITE_OK) {
+		FAVORITES_LOGE("sqlite3_bind is failed.\n");
+		sqlite3_finalize(stmt);
+		return -1;
 	}
-	FAVORITES_LOGE("sqlite3_step is failed");
-	_favorites_close_bookmark_db();
-	return 0;
+	nError = sqlite3_step(stmt);
+	if (nError == SQLITE_ROW)
+		bookmark_id = sqlite3_column_int(stmt, 0);
+	else if (nError != SQLITE_DONE)
+		bookmark_id = -1;
+	sqlite3_finalize(stmt);
+	return bookmark_id;
 }
 
 int _favorites_bookmark_is_bookmark_exist
 	(const char *url, const char *title, const int folderId)
 {
-	FAVORITES_LOGE("folderId: %d", folderId);
-	int nError;
-	sqlite3_stmt *stmt;
-	char	query[1024];
+	FAVORITES_LOGD("folderId: %d", folderId);
+	int bookmark_id;
 
-	memset(&query, 0x00, sizeof(char)*1024);
-		
 	if (_favorites_open_bookmark_db() < 0) {
 		FAVORITES_LOGE("db_util_open is failed\n");
 		return -1;
 	}
 
-	sprintf(query, "select id from bookmarks where \
-			type=0 AND address='%s' AND title='%s' AND parent=%d"
-			, url, title, folderId);
-	FAVORITES_LOGE("query: %s", query);
-
 	/* check bookmark in the bookmark table */
-	nError = sqlite3_prepare_v2(gl_internet_bookmark_db,query
-			       ,-1, &stmt, NULL);
-
-	if (nError != SQLITE_OK) {
-		FAVORITES_LOGE("sqlite3_prepare_v2 is failed.\n");
-		_favorites_finalize_bookmark_db(stmt);
+	bookmark_id = _favorites_bookmark_find_bookmark(url, title, folderId);
+	_favorites_close_bookmark_db();
+	if (bookmark_id < 0)
 		return -1;
-	}
-
-	nError = sqlite3_step(stmt);
-	if (nError == SQLITE_ROW) {
+	if (bookmark_id > 0) {
 		/* There is same bookmark exist. */
-		_favorites_finalize_bookmark_db(stmt);
 		return 1;
 	}
 
-	FAVORITES_LOGE("there is no identical bookmark\n");
-	_favorites_close_bookmark_db();
+	FAVORITES_LOGD("there is no identical bookmark\n");
 	/* there is no identical bookmark*/
 	return 0;
 }
@@ -320,8 +621,28 @@ int _favorites_get_bookmark_count_at_folder(int folderId)
 {
 	int nError;
 	sqlite3_stmt *stmt;
-	FAVORITES_LOGE("");
-	
+	FAVORITES_LOGD("");
+
+	if (_favorites_open_bookmark_db() < 0) {
+		FAVORITES_LOGE("db_util_open is failed\n");
+		return -1;
+	}
+
+	/* trigger-maintained count, a folder without a row is empty */
+	nError = sqlite3_prepare_v2(gl_internet_bookmark_db,
+			       "select coalesce((select bookmarks from favorites_folder_counts\
+			       where folder_id=?), 0)",
+			       -1, &stmt, NULL);
+	if (nError == SQLITE_OK) {
+		sqlite3_bind_int(stmt, 1, folderId);
+		if (sqlite3_step(stmt) == SQLITE_ROW) {
+			int count = sqlite3_column_int(stmt, 0);
+			_favorites_finalize_bookmark_db(stmt);
+			return count;
+		}
+	}
+	_favorites_finalize_bookmark_db(stmt);
+
 	if (_favorites_open_bookmark_db() < 0) {
 		FAVORITES_LOGE("db_util_open is failed\n");
 		return -1;
@@ -347,11 +668,11 @@ int _favorites_get_bookmark_count_at_folder(int folderId)
 	if (nError == SQLITE_ROW) {
 		int count = sqlite3_column_int(stmt, 0);
 		_favorites_finalize_bookmark_db(stmt);
-		FAVORITES_LOGE("count: %d", count);
+		FAVORITES_LOGD("count: %d", count);
 		return count;
 	}
 	_favorites_close_bookmark_db();
-	FAVORITES_LOGE("End");
+	FAVORITES_LOGD("End");
 	return 0;
 }
 
@@ -359,8 +680,19 @@ int _favorites_bookmark_get_folder_count(void)
 {
 	int nError;
 	sqlite3_stmt *stmt;
-	FAVORITES_LOGE("");
-	
+	sqlite3_int64 value;
+	FAVORITES_LOGD("");
+
+	if (_favorites_open_bookmark_db() < 0) {
+		FAVORITES_LOGE("db_util_open is failed\n");
+		return -1;
+	}
+	if (_favorites_bookmark_get_meta("folders_count", &value) == 0) {
+		_favorites_close_bookmark_db();
+		return (int)value;
+	}
+	_favorites_close_bookmark_db();
+
 	if (_favorites_open_bookmark_db() < 0) {
 		FAVORITES_LOGE("db_util_open is failed\n");
 		return -1;
@@ -389,16 +721,23 @@ int _favorites_bookmark_get_folder_count(void)
 bookmark_list_h _favorites_get_bookmark_list_at_folder(int folderId)
 {
 	bookmark_list_h m_list = NULL;
+	bookmark_list_h cache;
 	int nError;
 	sqlite3_stmt *stmt;
 	char	query[1024];
 
-	FAVORITES_LOGE("folderId: %d", folderId);
+	FAVORITES_LOGD("folderId: %d", folderId);
 	if(folderId<=0){
 		FAVORITES_LOGE("folderId is wrong");
 		return NULL;
 	}
 
+	if ((cache = _favorites_bookmark_cache_acquire()) != NULL) {
+		m_list = _favorites_bookmark_cache_filter(cache, 0, folderId);
+		_favorites_bookmark_cache_release(cache);
+		return m_list;
+	}
+
 	memset(&query, 0x00, sizeof(char)*1024);
 
 	/* check the total count of items */
@@ -411,9 +750,9 @@ bookmark_list_h _favorites_get_bookmark_list_at_folder(int folderId)
 	/* Get bookmarks list only under given folder */
 	sprintf(query, "select id, type, parent, address, title, editable,\
 			       creationdate, updatedate, sequence \
-			       from bookmarks where type=0 and parent =%d order by sequence"
+			       from bookmarks where type=0 and parent =%d order by sequence, id"
 			, folderId);
-	FAVORITES_LOGE("query: %s", query);
+	FAVORITES_LOGD("query: %s", query);
 
 	if (_favorites_open_bookmark_db() < 0) {
 		FAVORITES_LOGE("db_util_open is failed\n");
@@ -466,7 +805,7 @@ bookmark_list_h _favorites_get_bookmark_list_at_folder(int folderId)
 				    (char *)calloc(length + 1, sizeof(char));
 				memcpy(m_list->item[i].title, title, length);
 			}
-			FAVORITES_LOGE("Bookmark Title:%s\n", m_list->item[i].title);
+			FAVORITES_LOGD("Bookmark Title:%s\n", m_list->item[i].title);
 		}
 		m_list->item[i].editable = sqlite3_column_int(stmt, 5);
 
@@ -513,11 +852,18 @@ bookmark_list_h _favorites_get_bookmark_list_at_folder(int folderId)
 bookmark_list_h _favorites_bookmark_get_folder_list(void)
 {
 	bookmark_list_h m_list = NULL;
+	bookmark_list_h cache;
 	int nError;
 	sqlite3_stmt *stmt;
 	char	query[1024];
 
-	FAVORITES_LOGE("");
+	FAVORITES_LOGD("");
+
+	if ((cache = _favorites_bookmark_cache_acquire()) != NULL) {
+		m_list = _favorites_bookmark_cache_filter(cache, 1, -1);
+		_favorites_bookmark_cache_release(cache);
+		return m_list;
+	}
 
 	memset(&query, 0x00, sizeof(char)*1024);
 
@@ -531,8 +877,8 @@ bookmark_list_h _favorites_bookmark_get_folder_list(void)
 	/* Get bookmarks list only under given folder */
 	sprintf(query, "select id, type, parent, address, title, editable,\
 			       creationdate, updatedate, sequence \
-			       from bookmarks where type=1 and parent != 0 order by sequence");
-	FAVORITES_LOGE("query: %s", query);
+			       from bookmarks where type=1 and parent != 0 order by sequence, id");
+	FAVORITES_LOGD("query: %s", query);
 
 	if (_favorites_open_bookmark_db() < 0) {
 		FAVORITES_LOGE("db_util_open is failed\n");
@@ -585,7 +931,7 @@ bookmark_list_h _favorites_bookmark_get_folder_list(void)
 				    (char *)calloc(length + 1, sizeof(char));
 				memcpy(m_list->item[i].title, title, length);
 			}
-			FAVORITES_LOGE("Bookmark Title:%s\n", m_list->item[i].title);
+			FAVORITES_LOGD("Bookmark Title:%s\n", m_list->item[i].title);
 		}
 		m_list->item[i].editable = sqlite3_column_int(stmt, 5);
 
@@ -639,7 +985,7 @@ int _favorites_get_unixtime_from_datetime(char *datetime)
 		return -1;
 	}
 
-	FAVORITES_LOGE("datetime: %s\n", datetime);
+	FAVORITES_LOGD("datetime: %s\n", datetime);
 
 	if (_favorites_open_bookmark_db() < 0) {
 		FAVORITES_LOGE("db_util_open is failed\n");
@@ -671,133 +1017,388 @@ int _favorites_get_unixtime_from_datetime(char *datetime)
 	return 1;
 }
 
-/* search last of sequence(order's index) */
 int _favorites_bookmark_get_bookmark_id(const char *url, const char *title, const int folder_id)
 {
-	int nError;
-	sqlite3_stmt *stmt;
-	char	query[1024];
-
-	/* Get the id of bookmark */
-	sprintf(query, "select id from bookmarks where \
-			type=0 AND address='%s' AND title='%s' AND parent=%d"
-			, url, title, folder_id);
-	FAVORITES_LOGE("query: %s", query);
+	int bookmark_id;
 
 	if (_favorites_open_bookmark_db() < 0) {
 		FAVORITES_LOGE("db_util_open is failed\n");
 		return -1;
 	}
 
-	nError = sqlite3_prepare_v2(gl_internet_bookmark_db,
-				query, -1, &stmt, NULL);
+	/* Get the id of bookmark */
+	bookmark_id = _favorites_bookmark_find_bookmark(url, title, folder_id);
+	_favorites_close_bookmark_db();
+	if (bookmark_id == 0)
+		FAVORITES_LOGD("No match with given url");
+	return bookmark_id;
+}
+
+/* Reads type, parent and sequence of the item on the opened db.
+ * Returns 1 if found, 0 if there is none or -1. */
+static int _favorites_bookmark_get_position(int id, int *type, int *parent, int *sequence)
+{
+	int nError;
+	int found = 0;
+	sqlite3_stmt *stmt;
 
+	nError = sqlite3_prepare_v2(gl_internet_bookmark_db,
+			"select type, parent, sequence from bookmarks where id=?",
+			-1, &stmt, NULL);
 	if (nError != SQLITE_OK) {
-		FAVORITES_LOGE("sqlite3_prepare_v2 is failed");
-		_favorites_finalize_bookmark_db(stmt);
+		FAVORITES_LOGE("sqlite3_prepare_v2 is failed.\n");
+		sqlite3_finalize(stmt);
+		return -1;
+	}
+	if (sqlite3_bind_int(stmt, 1, id) != SQLITE_OK) {
+		FAVORITES_LOGE("sqlite3_bind_int is failed");
+		sqlite3_finalize(stmt);
 		return -1;
 	}
+	nError = sqlite3_step(stmt);
+	if (nError == SQLITE_ROW) {
+		*type = sqlite3_column_int(stmt, 0);
+		*parent = sqlite3_column_int(stmt, 1);
+		*sequence = sqlite3_column_int(stmt, 2);
+		found = 1;
+	} else if (nError != SQLITE_DONE) {
+		found = -1;
+	}
+	sqlite3_finalize(stmt);
+	return found;
+}
 
-	if ((nError = sqlite3_step(stmt)) == SQLITE_ROW) {
-		int bookmark_id = sqlite3_column_int(stmt, 0);
-		_favorites_finalize_bookmark_db(stmt);
-		return bookmark_id;
+static int _favorites_bookmark_set_sequence(sqlite3_stmt *stmt, int id, int sequence)
+{
+	sqlite3_reset(stmt);
+	if (sqlite3_bind_int(stmt, 1, sequence) != SQLITE_OK
+			|| sqlite3_bind_int(stmt, 2, id) != SQLITE_OK) {
+		FAVORITES_LOGE("sqlite3_bind_int is failed");
+		return -1;
+	}
+	if (sqlite3_step(stmt) != SQLITE_DONE) {
+		FAVORITES_LOGE("sqlite3_step is failed");
+		return -1;
 	}
-	FAVORITES_LOGE("No match with given url");
-	_favorites_close_bookmark_db();
 	return 0;
 }
 
-/*************************************************************
- *	APIs for Internet favorites
- *************************************************************/
-int favorites_bookmark_add_bookmark(const char *url, const char *title, const char *foldername, int *bookmark_id)
+/*
+ * Finds the sequence for item id inserted right before before_id in the
+ * folder, on the opened db. When there is no room left, the items from
+ * before_id on are spread again until the spacing reaches
+ * BOOKMARK_SEQUENCE_MIN_GAP, or up to the end of the folder.
+ */
+static int _favorites_bookmark_sequence_before(int folderId, int id,
+		int before_id, int before_sequence)
 {
-	FAVORITES_LOGE("");
 	int nError;
+	int prev = 0;
+	long long step = 0;
+	long long upper = 0;
+	int *window = NULL;
+	int count = 0;
+	int i;
+	int sequence = -1;
 	sqlite3_stmt *stmt;
-	int folderId = 1;
-	char	query[1024];
-	int lastIndex = 0;
 
-	memset(&query, 0x00, sizeof(char)*1024);
-	if (!url || (strlen(url) <= 0)) {
-		FAVORITES_LOGE("url is empty\n");
-		return FAVORITES_ERROR_INVALID_PARAMETER;
+	/* the item right before the insertion point, in (sequence, id) order */
+	nError = sqlite3_prepare_v2(gl_internet_bookmark_db,
+			"select sequence from bookmarks where parent=?1 and id!=?2\
+			and sequence<=?3 and not (sequence=?3 and id>=?4)\
+			order by sequence desc, id desc limit 1", -1, &stmt, NULL);
+	if (nError != SQLITE_OK) {
+		FAVORITES_LOGE("sqlite3_prepare_v2 is failed.\n");
+		sqlite3_finalize(stmt);
+		return -1;
 	}
+	sqlite3_bind_int(stmt, 1, folderId);
+	sqlite3_bind_int(stmt, 2, id);
+	sqlite3_bind_int(stmt, 3, before_sequence);
+	sqlite3_bind_int(stmt, 4, before_id);
+	/* sequences are kept positive, the first item has 0 before it */
+	nError = sqlite3_step(stmt);
+	if (nError == SQLITE_ROW)
+		prev = sqlite3_column_int(stmt, 0);
+	sqlite3_finalize(stmt);
+	if (nError != SQLITE_ROW && nError != SQLITE_DONE)
+		return -1;
 
-	if (!title || (strlen(title) <= 0)) {
+	if ((long long)before_sequence - prev >= 2)
+		return prev + (before_sequence - prev) / 2;
+
+	/* no room, collect the items to spread */
+	nError = sqlite3_prepare_v2(gl_internet_bookmark_db,
+			"select id, sequence from bookmarks where parent=?1 and id!=?2\
+			and sequence>=?3 and not (sequence=?3 and id<?4)\
+			order by sequence, id", -1, &stmt, NULL);
+	if (nError != SQLITE_OK) {
+		FAVORITES_LOGE("sqlite3_prepare_v2 is failed.\n");
+		sqlite3_finalize(stmt);
+		return -1;
+	}
+	sqlite3_bind_int(stmt, 1, folderId);
+	sqlite3_bind_int(stmt, 2, id);
+	sqlite3_bind_int(stmt, 3, before_sequence);
+	sqlite3_bind_int(stmt, 4, before_id);
+	while ((nError = sqlite3_step(stmt)) == SQLITE_ROW) {
+		upper = sqlite3_column_int(stmt, 1);
+		step = (upper - prev) / (count + 2);
+		if (count > 0 && step >= BOOKMARK_SEQUENCE_MIN_GAP)
+			break;
+		if ((count & (count - 1)) == 0) {
+			int *grown = (int *)realloc(window, (count ? count * 2 : 8) * sizeof(int));
+			if (grown == NULL) {
+				nError = SQLITE_NOMEM;
+				break;
+			}
+			window = grown;
+		}
+		window[count++] = sqlite3_column_int(stmt, 0);
+	}
+	sqlite3_finalize(stmt);
+	if (nError == SQLITE_DONE)
+		step = BOOKMARK_SEQUENCE_GAP;
+	else if (nError != SQLITE_ROW) {
+		free(window);
+		return -1;
+	}
+
+	nError = sqlite3_prepare_v2(gl_internet_bookmark_db,
+			"update bookmarks set sequence=? where id=?", -1, &stmt, NULL);
+	if (nError != SQLITE_OK) {
+		FAVORITES_LOGE("sqlite3_prepare_v2 is failed.\n");
+		sqlite3_finalize(stmt);
+		free(window);
+		return -1;
+	}
+	FAVORITES_LOGD("spreading %d items", count);
+	sequence = prev + step;
+	for (i = 0; sequence >= 0 && i < count; i++) {
+		if (_favorites_bookmark_set_sequence(stmt, window[i], prev + step * (i + 2)) < 0)
+			sequence = -1;
+	}
+	sqlite3_finalize(stmt);
+	free(window);
+	return sequence;
+}
+
+/* Fills the entry from a row of id, type, parent, address, title,
+ * editable, creationdate, updatedate, sequence. The strings are copied and
+ * freed with _favorites_free_bookmark_entry(). */
+static void _favorites_bookmark_get_entry(sqlite3_stmt *stmt,
+		favorites_bookmark_entry_s *result)
+{
+	memset(result, 0x00, sizeof(favorites_bookmark_entry_s));
+	result->id = sqlite3_column_int(stmt, 0);
+	result->is_folder = sqlite3_column_int(stmt, 1);
+	result->folder_id = sqlite3_column_int(stmt, 2);
+
+	result->address = NULL;
+	if (!result->is_folder) {
+		const char *url = (const char *)(sqlite3_column_text(stmt, 3));
+		if (url) {
+			int length = strlen(url);
+			if (length > 0) {
+				result->address = (char *)calloc(length + 1, sizeof(char));
+				memcpy(result->address, url, length);
+				FAVORITES_LOGD ("url:%s\n", url);
+			}
+		}
+	}
+
+	const char *title = (const char *)(sqlite3_column_text(stmt, 4));
+	result->title = NULL;
+	if (title) {
+		int length = strlen(title);
+		if (length > 0) {
+			result->title = (char *)calloc(length + 1, sizeof(char));
+			memcpy(result->title, title, length);
+		}
+	}
+	result->editable = sqlite3_column_int(stmt, 5);
+
+	const char *creation_date = (const char *)(sqlite3_column_text(stmt, 6));
+	result->creation_date = NULL;
+	if (creation_date) {
+		int length = strlen(creation_date);
+		if (length > 0) {
+			result->creation_date = (char *)calloc(length + 1, sizeof(char));
+			memcpy(result->creation_date, creation_date, length);
+		}
+	}
+	const char *update_date = (const char *)(sqlite3_column_text(stmt, 7));
+	result->update_date = NULL;
+	if (update_date) {
+		int length = strlen(update_date);
+		if (length > 0) {
+			result->update_date = (char *)calloc(length + 1, sizeof(char));
+			memcpy(result->update_date, update_date, length);
+		}
+	}
+
+	result->order_index = sqlite3_column_int(stmt, 8);
+}
+
+/* Whether id is folder_id or one of its descendants, on the opened db.
+ * Returns 1, 0 or -1. */
+static int _favorites_bookmark_is_in_subtree(int id, int folder_id)
+{
+	int nError;
+	int found = 0;
+	sqlite3_stmt *stmt;
+
+	nError = sqlite3_prepare_v2(gl_internet_bookmark_db,
+			"with recursive subtree(id) as (select ?1\
+			union select b.id from bookmarks b, subtree s where b.parent=s.id)\
+			select 1 from subtree where id=?2 limit 1", -1, &stmt, NULL);
+	if (nError != SQLITE_OK) {
+		FAVORITES_LOGE("sqlite3_prepare_v2 is failed.\n");
+		sqlite3_finalize(stmt);
+		return -1;
+	}
+	sqlite3_bind_int(stmt, 1, folder_id);
+	sqlite3_bind_int(stmt, 2, id);
+	nError = sqlite3_step(stmt);
+	if (nError == SQLITE_ROW)
+		found = 1;
+	else if (nError != SQLITE_DONE)
+		found = -1;
+	sqlite3_finalize(stmt);
+	return found;
+}
+
+/*************************************************************
+ *	APIs for Internet favorites
+ *************************************************************/
+int favorites_bookmark_add_bookmark(const char *url, const char *title, const char *foldername, int *bookmark_id)
+{
+	FAVORITES_API_ENTER();
+	FAVORITES_WRITABLE_CHECK();
+	FAVORITES_LOGD("");
+	int nError;
+	int ret = FAVORITES_ERROR_NONE;
+	sqlite3_stmt *stmt;
+	int folderId = 1;
+	int lastIndex = 0;
+	int id = 0;
+
+	if (!url || (strlen(url) <= 0)) {
+		FAVORITES_LOGE("url is empty\n");
+		return FAVORITES_ERROR_INVALID_PARAMETER;
+	}
+
+	if (!title || (strlen(title) <= 0)) {
 		FAVORITES_LOGE("title is empty\n");
 		return FAVORITES_ERROR_INVALID_PARAMETER;
 	}
 
+	if (_favorites_open_bookmark_db() < 0) {
+		FAVORITES_LOGE("db_util_open is failed\n");
+		return FAVORITES_ERROR_DB_FAILED;
+	}
+	/* The folder, the duplicate check, the sequence and the insert are
+	 * resolved on this one connection, by one writer at a time. */
+	if (_favorites_db_exec(gl_internet_bookmark_db, "begin immediate") < 0) {
+		_favorites_close_bookmark_db();
+		return FAVORITES_ERROR_DB_FAILED;
+	}
+
 	/* check the foldername is exist and get a folderid */
 	if (!foldername || (strlen(foldername) <= 0)) {
-		FAVORITES_LOGE("foldername is empty. id is now root.\n");
+		FAVORITES_LOGD("foldername is empty. id is now root.\n");
 		folderId = 1;
 	}else if (!strcmp("Bookmarks", foldername)){
 		/*root folder name is "Bookmarks".*/
 		folderId = 1;
 	} else {
-		folderId = _favorites_bookmark_get_folderID(foldername);
-		if(folderId<0){
-			return FAVORITES_ERROR_DB_FAILED;
-		}
+		folderId = _favorites_bookmark_lookup_folder(foldername);
+		/* If there is no identical folder name, create new folder */
+		if (folderId == 0)
+			folderId = _favorites_bookmark_insert_folder(foldername, 1);
+		if (folderId < 0)
+			ret = FAVORITES_ERROR_DB_FAILED;
 	}
 
 	/* Check the bookmarks is already exist*/
-	if(_favorites_bookmark_is_bookmark_exist(url, title, folderId)!=0){
-		FAVORITES_LOGE("The bookmark is already exist.\n");
-		return FAVORITES_ERROR_ITEM_ALREADY_EXIST;
+	if (ret == FAVORITES_ERROR_NONE) {
+		nError = _favorites_bookmark_find_bookmark(url, title, folderId);
+		if (nError < 0) {
+			ret = FAVORITES_ERROR_DB_FAILED;
+		} else if (nError != 0) {
+			FAVORITES_LOGW("The bookmark is already exist.\n");
+			ret = FAVORITES_ERROR_ITEM_ALREADY_EXIST;
+		}
 	}
 
 	/* get a last index for order of bookmark items */
-	if ((lastIndex = _favorites_get_bookmark_lastindex(folderId)) < 0) {
+	if (ret == FAVORITES_ERROR_NONE
+			&& (lastIndex = _favorites_bookmark_next_sequence(folderId, 0)) < 0) {
 		FAVORITES_LOGE("Database::getLastIndex() is failed.\n");
-		return FAVORITES_ERROR_DB_FAILED;
+		ret = FAVORITES_ERROR_DB_FAILED;
+	}
+
+	if (ret == FAVORITES_ERROR_NONE) {
+		ret = FAVORITES_ERROR_DB_FAILED;
+		nError = sqlite3_prepare_v2(gl_internet_bookmark_db,
+				"insert into bookmarks\
+				(type, parent, address, title, creationdate, editable, sequence, accesscount, url_hash)\
+				values(0, ?, ?, ?, DATETIME('now'), 1, ?, 0, ?)",
+				-1, &stmt, NULL);
+		if (nError != SQLITE_OK) {
+			FAVORITES_LOGE("sqlite3_prepare_v2 is failed.\n");
+		} else if (sqlite3_bind_int(stmt, 1, folderId) != SQLITE_OK
+				|| sqlite3_bind_text(stmt, 2, url, -1, NULL) != SQLITE_OK
+				|| sqlite3_bind_text(stmt, 3, title, -1, NULL) != SQLITE_OK
+				|| sqlite3_bind_int(stmt, 4, lastIndex) != SQLITE_OK
+				|| sqlite3_bind_int64(stmt, 5, _favorites_db_url_hash(url)) != SQLITE_OK) {
+			FAVORITES_LOGE("sqlite3_bind is failed.\n");
+		} else if ((nError = sqlite3_step(stmt)) != SQLITE_DONE) {
+			FAVORITES_LOGE("sqlite3_step is failed");
+		} else {
+			id = (int)sqlite3_last_insert_rowid(gl_internet_bookmark_db);
+			ret = FAVORITES_ERROR_NONE;
+		}
+		sqlite3_finalize(stmt);
 	}
 
-	/* Creating SQL query sentence. */
-	sprintf(query, "insert into bookmarks\
-			(type, parent, address, title, creationdate, editable, sequence, accesscount)\
-			values(0, %d, '%s', '%s',  DATETIME('now'), 1, %d, 0);"
-			, folderId, url, title, lastIndex);
-
-	if (_favorites_open_bookmark_db() < 0) {
-		FAVORITES_LOGE("db_util_open is failed\n");
-		return FAVORITES_ERROR_DB_FAILED;
+	if (ret != FAVORITES_ERROR_NONE
+			|| _favorites_db_exec(gl_internet_bookmark_db, "commit") < 0) {
+		sqlite3_exec(gl_internet_bookmark_db, "rollback", NULL, NULL, NULL);
+		if (ret == FAVORITES_ERROR_NONE)
+			ret = FAVORITES_ERROR_DB_FAILED;
 	}
-
-	nError = sqlite3_prepare_v2(gl_internet_bookmark_db,
-				query, -1, &stmt, NULL);
-
-	if (nError != SQLITE_OK) {
-		FAVORITES_LOGE("sqlite3_prepare_v2 is failed.\n");
-		_favorites_finalize_bookmark_db(stmt);
-		return FAVORITES_ERROR_DB_FAILED;
-	}
-	
-	nError = sqlite3_step(stmt);
-	if (nError == SQLITE_OK || nError == SQLITE_DONE) {
-		_favorites_finalize_bookmark_db(stmt);
-		if (bookmark_id != NULL) {
-			*bookmark_id = _favorites_bookmark_get_bookmark_id(url, title, folderId);
-		}
-		return FAVORITES_ERROR_NONE;
-	}
-	FAVORITES_LOGE("sqlite3_step is failed");
 	_favorites_close_bookmark_db();
+	if (ret != FAVORITES_ERROR_NONE)
+		return ret;
 
-	return FAVORITES_ERROR_DB_FAILED;
+	_favorites_bookmark_cache_invalidate();
+	_favorites_url_filter_add(_favorites_db_url_hash(url));
+	if (bookmark_id != NULL)
+		*bookmark_id = id;
+	return FAVORITES_ERROR_NONE;
 }
 
 int favorites_bookmark_get_count(int *count)
 {
+	FAVORITES_API_ENTER();
 	int nError;
 	sqlite3_stmt *stmt;
+	sqlite3_int64 value;
 
 	FAVORITES_NULL_ARG_CHECK(count);
-	
+
+	if (_favorites_open_bookmark_db() < 0) {
+		FAVORITES_LOGE("db_util_open is failed\n");
+		return FAVORITES_ERROR_DB_FAILED;
+	}
+	if (_favorites_bookmark_get_meta("bookmarks_count", &value) == 0) {
+		_favorites_close_bookmark_db();
+		*count = (int)value;
+		return FAVORITES_ERROR_NONE;
+	}
+	_favorites_close_bookmark_db();
+
 	if (_favorites_open_bookmark_db() < 0) {
 		FAVORITES_LOGE("db_util_open is failed\n");
 		return FAVORITES_ERROR_DB_FAILED;
@@ -823,12 +1424,118 @@ int favorites_bookmark_get_count(int *count)
 	return FAVORITES_ERROR_DB_FAILED;
 }
 
+/* urls bound per statement in favorites_bookmark_lookup_urls(), three
+ * variables each, kept below the default SQLITE_MAX_VARIABLE_NUMBER of 999 */
+#define LOOKUP_URLS_BATCH_SIZE	256
+
+int favorites_bookmark_lookup_urls(const char **urls, int n, int *out_ids)
+{
+	FAVORITES_API_ENTER();
+	FAVORITES_NULL_ARG_CHECK(urls);
+	FAVORITES_NULL_ARG_CHECK(out_ids);
+	FAVORITES_INVALID_ARG_CHECK(n<=0);
+	int nError;
+	int i;
+	int ret = FAVORITES_ERROR_NONE;
+	char *query;
+	sqlite3_stmt *stmt;
+
+	memset(out_ids, 0x00, n * sizeof(int));
+
+	query = (char *)calloc(1, 1024 + LOOKUP_URLS_BATCH_SIZE * 8);
+	if (query == NULL)
+		return FAVORITES_ERROR_DB_FAILED;
+	if (_favorites_open_bookmark_db() < 0) {
+		FAVORITES_LOGE("db_util_open is failed\n");
+		free(query);
+		return FAVORITES_ERROR_DB_FAILED;
+	}
+
+	/* one statement per batch: the urls are bound as the rows of a VALUES
+	 * table joined to bookmarks through bookmarks_url_hash_idx, which needs
+	 * no temp table, so it runs on read-only connections as well. The rows
+	 * the browser wrote without a hash are joined separately, so that the
+	 * hash lookups are not turned into a scan; "+type" keeps the planner
+	 * off the type index. */
+	for (i = 0; i < n && ret == FAVORITES_ERROR_NONE; i += LOOKUP_URLS_BATCH_SIZE) {
+		int batch = n - i < LOOKUP_URLS_BATCH_SIZE ? n - i : LOOKUP_URLS_BATCH_SIZE;
+		int k;
+		char *p;
+
+		p = query + sprintf(query, "with l(idx, url_hash, address) as (values ");
+		for (k = 0; k < batch; k++)
+			p += sprintf(p, k ? ",(?,?,?)" : "(?,?,?)");
+		sprintf(p, ") select idx, min(id) from (\
+				select l.idx, b.id from l, bookmarks b\
+				where b.url_hash=l.url_hash and b.address=l.address and +b.type=0\
+				union all\
+				select l.idx, b.id from bookmarks b, l\
+				where b.url_hash is null and b.address=l.address and +b.type=0)\
+				group by idx");
+
+		nError = sqlite3_prepare_v2(gl_internet_bookmark_db, query, -1, &stmt, NULL);
+		if (nError != SQLITE_OK) {
+			FAVORITES_LOGE("sqlite3_prepare_v2 is failed(%s).\n",
+				sqlite3_errmsg(gl_internet_bookmark_db));
+			sqlite3_finalize(stmt);
+			ret = FAVORITES_ERROR_DB_FAILED;
+			break;
+		}
+		for (k = 0; k < batch; k++) {
+			sqlite3_bind_int(stmt, k * 3 + 1, i + k);
+			/* a NULL url is left unbound, and matches nothing */
+			if (urls[i + k] == NULL)
+				continue;
+			sqlite3_bind_int64(stmt, k * 3 + 2, _favorites_db_url_hash(urls[i + k]));
+			sqlite3_bind_text(stmt, k * 3 + 3, urls[i + k], -1, NULL);
+		}
+		while ((nError = sqlite3_step(stmt)) == SQLITE_ROW)
+			out_ids[sqlite3_column_int(stmt, 0)] = sqlite3_column_int(stmt, 1);
+		if (nError != SQLITE_DONE) {
+			FAVORITES_LOGE("sqlite3_step is failed");
+			ret = FAVORITES_ERROR_DB_FAILED;
+		}
+		sqlite3_finalize(stmt);
+	}
+	free(query);
+	_favorites_close_bookmark_db();
+	return ret;
+}
+
 int favorites_bookmark_foreach(favorites_bookmark_foreach_cb callback,void *user_data)
 {
+	FAVORITES_API_ENTER();
 	FAVORITES_NULL_ARG_CHECK(callback);
 	int nError;
 	int func_ret = 0;
+	int rows = 0;
 	sqlite3_stmt *stmt;
+	bookmark_list_h cache;
+	FAVORITES_TRACE_BEGIN(FAVORITES_TRACE_LEVEL_DEBUG, trace_start);
+
+	if ((cache = _favorites_bookmark_cache_acquire()) != NULL) {
+		int i;
+		for (i = 0; i < cache->count; i++) {
+			favorites_bookmark_entry_s result;
+			/* the strings belong to the snapshot and stay valid while
+			 * the callback runs */
+			memset(&result, 0x00, sizeof(favorites_bookmark_entry_s));
+			result.id = cache->item[i].id;
+			result.is_folder = cache->item[i].is_folder;
+			result.folder_id = cache->item[i].folder_id;
+			result.address = cache->item[i].address;
+			result.title = cache->item[i].title;
+			result.editable = cache->item[i].editable;
+			result.creation_date = cache->item[i].creationdate;
+			result.update_date = cache->item[i].updatedate;
+			result.order_index = cache->item[i].orderIndex;
+			if (callback(&result, user_data) == 0)
+				break;
+		}
+		_favorites_bookmark_cache_release(cache);
+		FAVORITES_TRACE_END(trace_start, "foreach cache", i);
+		return FAVORITES_ERROR_NONE;
+	}
 
 	if (_favorites_open_bookmark_db() < 0) {
 		FAVORITES_LOGE("db_util_open is failed\n");
@@ -837,7 +1544,7 @@ int favorites_bookmark_foreach(favorites_bookmark_foreach_cb callback,void *user
 	nError = sqlite3_prepare_v2(gl_internet_bookmark_db,
 			       "select id, type, parent, address, title, editable,\
 			       creationdate, updatedate, sequence \
-			       from bookmarks where parent != 0 order by sequence",
+			       from bookmarks where parent != 0 order by sequence, id",
 			       -1, &stmt, NULL);
 	if (nError != SQLITE_OK) {
 		FAVORITES_LOGE ("sqlite3_prepare_v2 is failed.\n");
@@ -847,69 +1554,137 @@ int favorites_bookmark_foreach(favorites_bookmark_foreach_cb callback,void *user
 
 	while ((nError = sqlite3_step(stmt)) == SQLITE_ROW) {
 		favorites_bookmark_entry_s result;
-		memset(&result, 0x00, sizeof(favorites_bookmark_entry_s));
-		result.id = sqlite3_column_int(stmt, 0);
-		result.is_folder = sqlite3_column_int(stmt, 1);
-		result.folder_id = sqlite3_column_int(stmt, 2);
-
-		result.address = NULL;
-		if (!result.is_folder) {
-			const char *url = (const char *)(sqlite3_column_text(stmt, 3));
-			if (url) {
-				int length = strlen(url);
-				if (length > 0) {
-					result.address = (char *)calloc(length + 1, sizeof(char));
-					memcpy(result.address, url, length);
-					FAVORITES_LOGE ("url:%s\n", url);
-				}
-			}
-		}
+		_favorites_bookmark_get_entry(stmt, &result);
 
-		const char *title = (const char *)(sqlite3_column_text(stmt, 4));
-		result.title = NULL;
-		if (title) {
-			int length = strlen(title);
-			if (length > 0) {
-				result.title = (char *)calloc(length + 1, sizeof(char));
-				memcpy(result.title, title, length);
-			}
-		}
-		result.editable = sqlite3_column_int(stmt, 5);
+		func_ret = callback(&result, user_data);
+		_favorites_free_bookmark_entry(&result);
+		rows++;
+		if(func_ret == 0) 
+			break;
+	}
 
-		const char *creation_date = (const char *)(sqlite3_column_text(stmt, 6));
-		result.creation_date = NULL;
-		if (creation_date) {
-			int length = strlen(creation_date);
-			if (length > 0) {
-				result.creation_date = (char *)calloc(length + 1, sizeof(char));
-				memcpy(result.creation_date, creation_date, length);
-			}
-		}
-		const char *update_date = (const char *)(sqlite3_column_text(stmt, 7));
-		result.update_date = NULL;
-		if (update_date) {
-			int length = strlen(update_date);
-			if (length > 0) {
-				result.update_date = (char *)calloc(length + 1, sizeof(char));
-				memcpy(result.update_date, update_date, length);
-			}
-		}
+	FAVORITES_LOGD ("There are no more bookmarks.\n");
+	_favorites_finalize_bookmark_db(stmt);
+	FAVORITES_TRACE_END(trace_start, "foreach db", rows);
+	return FAVORITES_ERROR_NONE;
+}
 
-		result.order_index = sqlite3_column_int(stmt, 8);
+int favorites_bookmark_foreach_tree(favorites_bookmark_tree_cb callback, void *user_data)
+{
+	FAVORITES_API_ENTER();
+	FAVORITES_NULL_ARG_CHECK(callback);
+	int nError;
+	int func_ret = 0;
+	sqlite3_stmt *stmt;
 
-		func_ret = callback(&result, user_data);
+	if (_favorites_open_bookmark_db() < 0) {
+		FAVORITES_LOGE("db_util_open is failed\n");
+		return FAVORITES_ERROR_DB_FAILED;
+	}
+	/* path is the (sequence, id) of every ancestor, sorting on it lists
+	 * each folder right before its contents */
+	nError = sqlite3_prepare_v2(gl_internet_bookmark_db,
+			"with recursive tree(id, type, parent, address, title, editable,\
+				creationdate, updatedate, sequence, depth, path) as (\
+			select id, type, parent, address, title, editable,\
+				creationdate, updatedate, sequence, 0,\
+				printf('%010d%010d', sequence, id)\
+				from bookmarks where parent=1\
+			union all\
+			select b.id, b.type, b.parent, b.address, b.title, b.editable,\
+				b.creationdate, b.updatedate, b.sequence, t.depth + 1,\
+				t.path || printf('%010d%010d', b.sequence, b.id)\
+				from bookmarks b, tree t\
+				where t.type=1 and b.parent=t.id and t.depth<?)\
+			select id, type, parent, address, title, editable,\
+				creationdate, updatedate, sequence, depth\
+				from tree order by path",
+			-1, &stmt, NULL);
+	if (nError != SQLITE_OK) {
+		FAVORITES_LOGE ("sqlite3_prepare_v2 is failed.\n");
+		_favorites_finalize_bookmark_db(stmt);
+		return FAVORITES_ERROR_DB_FAILED;
+	}
+	if (sqlite3_bind_int(stmt, 1, BOOKMARK_TREE_MAX_DEPTH - 1) != SQLITE_OK) {
+		FAVORITES_LOGE("sqlite3_bind_int is failed");
+		_favorites_finalize_bookmark_db(stmt);
+		return FAVORITES_ERROR_DB_FAILED;
+	}
+
+	while ((nError = sqlite3_step(stmt)) == SQLITE_ROW) {
+		favorites_bookmark_entry_s result;
+		_favorites_bookmark_get_entry(stmt, &result);
+
+		func_ret = callback(&result, sqlite3_column_int(stmt, 9), user_data);
 		_favorites_free_bookmark_entry(&result);
-		if(func_ret == 0) 
+		if(func_ret == 0)
 			break;
 	}
+	if (nError != SQLITE_ROW && nError != SQLITE_DONE) {
+		FAVORITES_LOGE("sqlite3_step is failed");
+		_favorites_finalize_bookmark_db(stmt);
+		return FAVORITES_ERROR_DB_FAILED;
+	}
+	_favorites_finalize_bookmark_db(stmt);
+	return FAVORITES_ERROR_NONE;
+}
+
+int favorites_bookmark_foreach_folder_summary(favorites_bookmark_folder_summary_cb callback,
+		void *user_data)
+{
+	FAVORITES_API_ENTER();
+	FAVORITES_NULL_ARG_CHECK(callback);
+	int nError;
+	int func_ret = 0;
+	sqlite3_stmt *stmt;
 
-	FAVORITES_LOGE ("There are no more bookmarks.\n");
+	if (_favorites_open_bookmark_db() < 0) {
+		FAVORITES_LOGE("db_util_open is failed\n");
+		return FAVORITES_ERROR_DB_FAILED;
+	}
+	/* the items are grouped in bookmarks_parent_sequence_idx order, then
+	 * joined to their folder */
+	nError = sqlite3_prepare_v2(gl_internet_bookmark_db,
+			"select f.id, f.title, f.parent, coalesce(c.items, 0),\
+				c.updatedate, c.creationdate\
+			from bookmarks f left join (\
+				select parent, count(*) as items, max(updatedate) as updatedate,\
+					max(creationdate) as creationdate\
+				from bookmarks group by parent) c on c.parent=f.id\
+			where f.type=1 order by f.parent != 0, f.sequence, f.id",
+			-1, &stmt, NULL);
+	if (nError != SQLITE_OK) {
+		FAVORITES_LOGE ("sqlite3_prepare_v2 is failed.\n");
+		_favorites_finalize_bookmark_db(stmt);
+		return FAVORITES_ERROR_DB_FAILED;
+	}
+
+	while ((nError = sqlite3_step(stmt)) == SQLITE_ROW) {
+		favorites_bookmark_folder_summary_s summary;
+		/* the strings stay valid until the next step */
+		summary.id = sqlite3_column_int(stmt, 0);
+		summary.title = (char *)sqlite3_column_text(stmt, 1);
+		summary.folder_id = sqlite3_column_int(stmt, 2);
+		summary.item_count = sqlite3_column_int(stmt, 3);
+		summary.latest_update_date = (char *)sqlite3_column_text(stmt, 4);
+		summary.latest_creation_date = (char *)sqlite3_column_text(stmt, 5);
+
+		func_ret = callback(&summary, user_data);
+		if(func_ret == 0)
+			break;
+	}
+	if (nError != SQLITE_ROW && nError != SQLITE_DONE) {
+		FAVORITES_LOGE("sqlite3_step is failed");
+		_favorites_finalize_bookmark_db(stmt);
+		return FAVORITES_ERROR_DB_FAILED;
+	}
 	_favorites_finalize_bookmark_db(stmt);
 	return FAVORITES_ERROR_NONE;
 }
 
 int favorites_bookmark_export_list(const char * file_path)
 {
+	FAVORITES_API_ENTER();
 	FAVORITES_NULL_ARG_CHECK(file_path);
 	FILE *fp = NULL;
 	bookmark_list_h folders_list = NULL;
@@ -946,7 +1721,7 @@ int favorites_bookmark_export_list(const char * file_path)
 		folder_adddate_unixtime =
 			_favorites_get_unixtime_from_datetime(
 				folders_list->item[i].creationdate);
-		FAVORITES_LOGE("TITLE: %s", folders_list->item[i].title);
+		FAVORITES_LOGD("TITLE: %s", folders_list->item[i].title);
 
 		fprintf(fp, "\t<DT><H3 FOLDED ADD_DATE=\"%d\">%s</H3>\n", 
 				folder_adddate_unixtime, folders_list->item[i].title);
@@ -1023,72 +1798,795 @@ int favorites_bookmark_export_list(const char * file_path)
 	return FAVORITES_ERROR_NONE;
 }
 
+/* Sizes of the downscaled favicons stored along with each shared favicon */
+static const int gl_favicon_variant_sizes[] = { 16, 32, 64 };
+#define FAVICON_VARIANT_COUNT \
+	((int)(sizeof(gl_favicon_variant_sizes) / sizeof(gl_favicon_variant_sizes[0])))
+
+/* Smallest stored variant size not below the hint, 0 for the original */
+static int _favorites_bookmark_favicon_variant_size(int size_hint)
+{
+	int i;
+
+	if (size_hint <= 0)
+		return 0;
+	for (i = 0; i < FAVICON_VARIANT_COUNT; i++) {
+		if (gl_favicon_variant_sizes[i] >= size_hint)
+			return gl_favicon_variant_sizes[i];
+	}
+	return 0;
+}
+
 int favorites_bookmark_get_favicon(int id, Evas *evas, Evas_Object **icon)
 {
+	FAVORITES_API_ENTER();
+	return favorites_bookmark_get_favicon_with_size(id, 0, evas, icon);
+}
+
+int favorites_bookmark_get_favicon_with_size(int id, int size_hint, Evas *evas, Evas_Object **icon)
+{
+	FAVORITES_API_ENTER();
 	FAVORITES_INVALID_ARG_CHECK(id<0);
 	FAVORITES_NULL_ARG_CHECK(evas);
 	FAVORITES_NULL_ARG_CHECK(icon);
 
 	sqlite3_stmt *stmt;
-	char	query[1024];
-	void *favicon_data_temp=NULL;
 	favicon_entry_h favicon;
 	int nError;
+	int column;
+	int size = _favorites_bookmark_favicon_variant_size(size_hint);
 
-	memset(&query, 0x00, sizeof(char)*1024);
-	sprintf(query, "select favicon, favicon_length, favicon_w, favicon_h from bookmarks\
-			where id=%d"
-			, id);
-	FAVORITES_LOGE("query: %s", query);
+	favicon = _favorites_favicon_cache_lookup(id, size);
+	if (favicon == NULL) {
+		if (_favorites_open_bookmark_db() < 0) {
+			FAVORITES_LOGE("db_util_open is failed\n");
+			return FAVORITES_ERROR_DB_FAILED;
+		}
+
+		/* An inline favicon is newer than the shared one: it was written
+		 * by somebody unaware of the favicons table. It has no variants,
+		 * those only exist for shared favicons larger than the size. */
+		nError = sqlite3_prepare_v2(gl_internet_bookmark_db,
+				"select b.favicon, b.favicon_length, b.favicon_w, b.favicon_h,\
+				coalesce(v.data, f.data), coalesce(v.length, f.length),\
+				coalesce(v.w, f.w), coalesce(v.h, f.h) from bookmarks b\
+				left join favicons f on f.id=b.favicon_id\
+				left join favicon_variants v on v.favicon_id=b.favicon_id and v.size=?2\
+				where b.id=?1",
+				-1, &stmt, NULL);
+		if (nError != SQLITE_OK) {
+			/* favicons are not migrated in this db */
+			sqlite3_finalize(stmt);
+			nError = sqlite3_prepare_v2(gl_internet_bookmark_db,
+					"select favicon, favicon_length, favicon_w, favicon_h\
+					from bookmarks where id=?", -1, &stmt, NULL);
+		}
+		if (nError != SQLITE_OK) {
+			FAVORITES_LOGE("sqlite3_prepare_v2 is failed(%s).\n",
+				sqlite3_errmsg(gl_internet_bookmark_db));
+			_favorites_finalize_bookmark_db(stmt);
+			return FAVORITES_ERROR_DB_FAILED;
+		}
+		if (sqlite3_bind_int(stmt, 1, id) != SQLITE_OK
+				|| (sqlite3_bind_parameter_count(stmt) > 1
+					&& sqlite3_bind_int(stmt, 2, size) != SQLITE_OK)) {
+			FAVORITES_LOGE("sqlite3_bind_int is failed");
+			_favorites_finalize_bookmark_db(stmt);
+			return FAVORITES_ERROR_DB_FAILED;
+		}
+
+		nError = sqlite3_step(stmt);
+		if (nError != SQLITE_ROW) {
+			_favorites_finalize_bookmark_db(stmt);
+			return FAVORITES_ERROR_NONE;
+		}
+		/* loading favicon from bookmark db */
+		column = 0;
+		if (sqlite3_column_count(stmt) > 4 && sqlite3_column_int(stmt, 1) <= 0)
+			column = 4;
+		favicon = _favorites_favicon_cache_insert(id, size,
+				sqlite3_column_blob(stmt, column),
+				sqlite3_column_int(stmt, column + 1),
+				sqlite3_column_int(stmt, column + 2),
+				sqlite3_column_int(stmt, column + 3));
+		_favorites_finalize_bookmark_db(stmt);
+		if (favicon == NULL)
+			return FAVORITES_ERROR_DB_FAILED;
+	}
+
+	if (favicon->length > 0) {
+		/* transforming to evas object */
+		*icon = _favorites_favicon_cache_create_image(favicon, evas);
+	}
+	_favorites_favicon_cache_release(favicon);
+	return FAVORITES_ERROR_NONE;
+}
+
+/* ids bound per statement in favorites_bookmark_get_favicons(), kept below
+ * the default SQLITE_MAX_VARIABLE_NUMBER of 999 */
+#define FAVICON_BATCH_SIZE	512
+
+/* Reads a whole blob straight into a new buffer. The handle is moved to
+ * the given row, or opened on the first call. */
+static void *_favorites_bookmark_read_blob(sqlite3_blob **blob, const char *table,
+		const char *column, sqlite3_int64 rowid, int *length)
+{
+	void *data;
+	int nError;
+
+	if (*blob == NULL)
+		nError = sqlite3_blob_open(gl_internet_bookmark_db, "main", table,
+				column, rowid, 0, blob);
+	else
+		nError = sqlite3_blob_reopen(*blob, rowid);
+	if (nError != SQLITE_OK) {
+		/* a NULL column cannot be opened, it just has no favicon */
+		sqlite3_blob_close(*blob);
+		*blob = NULL;
+		return NULL;
+	}
+
+	*length = sqlite3_blob_bytes(*blob);
+	if (*length <= 0 || (data = malloc(*length)) == NULL)
+		return NULL;
+	if (sqlite3_blob_read(*blob, data, *length, 0) != SQLITE_OK) {
+		FAVORITES_LOGE("sqlite3_blob_read is failed");
+		free(data);
+		return NULL;
+	}
+	return data;
+}
+
+int favorites_bookmark_get_favicons(const int *bookmark_ids, int count, int size_hint,
+		Evas *evas, favorites_bookmark_favicon_cb callback, void *user_data)
+{
+	FAVORITES_API_ENTER();
+	FAVORITES_NULL_ARG_CHECK(bookmark_ids);
+	FAVORITES_INVALID_ARG_CHECK(count<0);
+	FAVORITES_NULL_ARG_CHECK(evas);
+	FAVORITES_NULL_ARG_CHECK(callback);
+
+	int *missed;
+	int missed_count = 0;
+	int i;
+	int stop = 0;
+	int ret = FAVORITES_ERROR_NONE;
+	char *query;
+	favicon_entry_h favicon;
+	int size = _favorites_bookmark_favicon_variant_size(size_hint);
+
+	missed = (int *)calloc(count > 0 ? count : 1, sizeof(int));
+	query = (char *)calloc(1, 512 + FAVICON_BATCH_SIZE * 2);
+	if (missed == NULL || query == NULL) {
+		_FAVORITES_FREE(missed);
+		_FAVORITES_FREE(query);
+		return FAVORITES_ERROR_DB_FAILED;
+	}
+
+	/* serve what is cached first */
+	for (i = 0; i < count && !stop; i++) {
+		if (bookmark_ids[i] < 0)
+			continue;
+		favicon = _favorites_favicon_cache_lookup(bookmark_ids[i], size);
+		if (favicon == NULL) {
+			missed[missed_count++] = bookmark_ids[i];
+			continue;
+		}
+		if (favicon->length > 0) {
+			Evas_Object *icon = _favorites_favicon_cache_create_image(favicon, evas);
+			if (icon != NULL && !callback(bookmark_ids[i], icon, user_data))
+				stop = 1;
+		}
+		_favorites_favicon_cache_release(favicon);
+	}
+
+	if (!stop && missed_count > 0 && _favorites_open_bookmark_db() < 0) {
+		FAVORITES_LOGE("db_util_open is failed\n");
+		ret = FAVORITES_ERROR_DB_FAILED;
+		stop = 1;
+	}
+
+	/* then the rest with one query per batch of ids, the blobs themselves
+	 * are read with incremental I/O */
+	for (i = 0; i < missed_count && !stop; i += FAVICON_BATCH_SIZE) {
+		int batch = missed_count - i < FAVICON_BATCH_SIZE ?
+				missed_count - i : FAVICON_BATCH_SIZE;
+		int k;
+		int joined = 1;
+		int nError;
+		sqlite3_stmt *stmt;
+		sqlite3_blob *inline_blob = NULL;
+		sqlite3_blob *shared_blob = NULL;
+		sqlite3_blob *variant_blob = NULL;
+		char *p;
+
+		p = query + sprintf(query, "select b.id, b.favicon_length, b.favicon_w,\
+				b.favicon_h, f.id, f.w, f.h, v.id, v.w, v.h from bookmarks b\
+				left join favicons f on f.id=b.favicon_id\
+				left join favicon_variants v on v.favicon_id=b.favicon_id and v.size=?\
+				where b.id in (");
+		for (k = 0; k < batch; k++)
+			p += sprintf(p, k ? ",?" : "?");
+		sprintf(p, ")");
+
+		nError = sqlite3_prepare_v2(gl_internet_bookmark_db, query, -1, &stmt, NULL);
+		if (nError != SQLITE_OK) {
+			/* favicons are not migrated in this db */
+			sqlite3_finalize(stmt);
+			joined = 0;
+			p = query + sprintf(query, "select id, favicon_length, favicon_w,\
+					favicon_h from bookmarks where id in (");
+			for (k = 0; k < batch; k++)
+				p += sprintf(p, k ? ",?" : "?");
+			sprintf(p, ")");
+			nError = sqlite3_prepare_v2(gl_internet_bookmark_db, query, -1, &stmt, NULL);
+		}
+		if (nError != SQLITE_OK) {
+			FAVORITES_LOGE("sqlite3_prepare_v2 is failed(%s).\n",
+				sqlite3_errmsg(gl_internet_bookmark_db));
+			sqlite3_finalize(stmt);
+			ret = FAVORITES_ERROR_DB_FAILED;
+			break;
+		}
+		if (joined)
+			sqlite3_bind_int(stmt, 1, size);
+		for (k = 0; k < batch; k++)
+			sqlite3_bind_int(stmt, k + 1 + joined, missed[i + k]);
+
+		while (!stop && (nError = sqlite3_step(stmt)) == SQLITE_ROW) {
+			int id = sqlite3_column_int(stmt, 0);
+			int length = 0;
+			int w;
+			int h;
+			void *data = NULL;
+
+			if (sqlite3_column_int(stmt, 1) > 0) {
+				w = sqlite3_column_int(stmt, 2);
+				h = sqlite3_column_int(stmt, 3);
+				data = _favorites_bookmark_read_blob(&inline_blob,
+						"bookmarks", "favicon", id, &length);
+			} else if (joined && sqlite3_column_type(stmt, 7) != SQLITE_NULL) {
+				w = sqlite3_column_int(stmt, 8);
+				h = sqlite3_column_int(stmt, 9);
+				data = _favorites_bookmark_read_blob(&variant_blob, "favicon_variants",
+						"data", sqlite3_column_int64(stmt, 7), &length);
+			} else if (joined && sqlite3_column_type(stmt, 4) != SQLITE_NULL) {
+				w = sqlite3_column_int(stmt, 5);
+				h = sqlite3_column_int(stmt, 6);
+				data = _favorites_bookmark_read_blob(&shared_blob, "favicons",
+						"data", sqlite3_column_int64(stmt, 4), &length);
+			} else {
+				w = h = 0;
+			}
+
+			favicon = _favorites_favicon_cache_insert_buffer(id, size, data, length, w, h);
+			if (favicon == NULL)
+				continue;
+			if (favicon->length > 0) {
+				Evas_Object *icon = _favorites_favicon_cache_create_image(favicon, evas);
+				if (icon != NULL && !callback(id, icon, user_data))
+					stop = 1;
+			}
+			_favorites_favicon_cache_release(favicon);
+		}
+		if (!stop && nError != SQLITE_DONE) {
+			FAVORITES_LOGE("sqlite3_step is failed");
+			ret = FAVORITES_ERROR_DB_FAILED;
+			stop = 1;
+		}
+		sqlite3_blob_close(inline_blob);
+		sqlite3_blob_close(shared_blob);
+		sqlite3_blob_close(variant_blob);
+		sqlite3_finalize(stmt);
+	}
+	if (missed_count > 0)
+		_favorites_close_bookmark_db();
+
+	free(query);
+	free(missed);
+	return ret;
+}
+
+/* FNV-1a over the pixels and geometry of a favicon */
+static sqlite3_int64 _favorites_bookmark_favicon_hash(const void *data,
+		int length, int w, int h)
+{
+	const unsigned char *p = (const unsigned char *)data;
+	unsigned long long hash = 14695981039346656037ULL;
+	int i;
+
+	for (i = 0; i < length; i++) {
+		hash ^= p[i];
+		hash *= 1099511628211ULL;
+	}
+	hash ^= ((unsigned long long)w << 32) | (unsigned int)h;
+	hash *= 1099511628211ULL;
+	return (sqlite3_int64)hash;
+}
+
+/* Stores the downscaled copies of a shared favicon. Sizes not below the
+ * original are skipped, the original is the closest variant for those. */
+static int _favorites_bookmark_add_favicon_variants(sqlite3_int64 favicon_id,
+		const void *data, int length, int w, int h)
+{
+	int nError;
+	int i;
+	int ret = 0;
+	sqlite3_stmt *stmt;
+	void *scaled;
+
+	if (w <= 0 || h <= 0 || length < w * h * 4)
+		return 0;
+
+	nError = sqlite3_prepare_v2(gl_internet_bookmark_db,
+			"insert or replace into favicon_variants\
+			(favicon_id, size, data, length, w, h) values (?, ?, ?, ?, ?, ?)",
+			-1, &stmt, NULL);
+	if (nError != SQLITE_OK) {
+		FAVORITES_LOGE("sqlite3_prepare_v2 is failed.\n");
+		sqlite3_finalize(stmt);
+		return -1;
+	}
+	scaled = malloc(gl_favicon_variant_sizes[FAVICON_VARIANT_COUNT - 1]
+			* gl_favicon_variant_sizes[FAVICON_VARIANT_COUNT - 1] * 4);
+	for (i = 0; scaled != NULL && ret == 0 && i < FAVICON_VARIANT_COUNT; i++) {
+		int size = gl_favicon_variant_sizes[i];
+		int sw = w >= h ? size : w * size / h;
+		int sh = w >= h ? h * size / w : size;
+
+		if (w <= size && h <= size)
+			break;
+		if (sw < 1)
+			sw = 1;
+		if (sh < 1)
+			sh = 1;
+		if (_favorites_favicon_scale(data, w, h, scaled, sw, sh) < 0)
+			continue;
+		sqlite3_bind_int64(stmt, 1, favicon_id);
+		sqlite3_bind_int(stmt, 2, size);
+		sqlite3_bind_blob(stmt, 3, scaled, sw * sh * 4, SQLITE_STATIC);
+		sqlite3_bind_int(stmt, 4, sw * sh * 4);
+		sqlite3_bind_int(stmt, 5, sw);
+		sqlite3_bind_int(stmt, 6, sh);
+		if (sqlite3_step(stmt) != SQLITE_DONE) {
+			FAVORITES_LOGE("sqlite3_step is failed");
+			ret = -1;
+		}
+		sqlite3_reset(stmt);
+	}
+	free(scaled);
+	sqlite3_finalize(stmt);
+	return ret;
+}
+
+/* Returns the id of the favicons row holding exactly this image, adding it
+ * when there is none yet; -1 on failure. */
+static sqlite3_int64 _favorites_bookmark_get_favicon_id(const void *data,
+		int length, int w, int h)
+{
+	int nError;
+	sqlite3_stmt *stmt;
+	sqlite3_int64 hash = _favorites_bookmark_favicon_hash(data, length, w, h);
+	sqlite3_int64 favicon_id = -1;
+
+	nError = sqlite3_prepare_v2(gl_internet_bookmark_db,
+			"select id, data, length, w, h from favicons where hash=?",
+			-1, &stmt, NULL);
+	if (nError != SQLITE_OK) {
+		FAVORITES_LOGE("sqlite3_prepare_v2 is failed.\n");
+		sqlite3_finalize(stmt);
+		return -1;
+	}
+	sqlite3_bind_int64(stmt, 1, hash);
+	while (favicon_id < 0 && (nError = sqlite3_step(stmt)) == SQLITE_ROW) {
+		if (sqlite3_column_int(stmt, 2) == length
+				&& sqlite3_column_int(stmt, 3) == w
+				&& sqlite3_column_int(stmt, 4) == h
+				&& sqlite3_column_bytes(stmt, 1) == length
+				&& !memcmp(sqlite3_column_blob(stmt, 1), data, length))
+			favicon_id = sqlite3_column_int64(stmt, 0);
+	}
+	sqlite3_finalize(stmt);
+	if (favicon_id >= 0)
+		return favicon_id;
+
+	nError = sqlite3_prepare_v2(gl_internet_bookmark_db,
+			"insert into favicons (hash, data, length, w, h) values (?, ?, ?, ?, ?)",
+			-1, &stmt, NULL);
+	if (nError != SQLITE_OK) {
+		FAVORITES_LOGE("sqlite3_prepare_v2 is failed.\n");
+		sqlite3_finalize(stmt);
+		return -1;
+	}
+	sqlite3_bind_int64(stmt, 1, hash);
+	sqlite3_bind_blob(stmt, 2, data, length, SQLITE_STATIC);
+	sqlite3_bind_int(stmt, 3, length);
+	sqlite3_bind_int(stmt, 4, w);
+	sqlite3_bind_int(stmt, 5, h);
+	nError = sqlite3_step(stmt);
+	sqlite3_finalize(stmt);
+	if (nError != SQLITE_DONE) {
+		FAVORITES_LOGE("sqlite3_step is failed");
+		return -1;
+	}
+	favicon_id = sqlite3_last_insert_rowid(gl_internet_bookmark_db);
+	if (_favorites_bookmark_add_favicon_variants(favicon_id, data, length, w, h) < 0)
+		return -1;
+	return favicon_id;
+}
+
+int favorites_bookmark_deduplicate_favicons(int *moved_count)
+{
+	FAVORITES_API_ENTER();
+	FAVORITES_WRITABLE_CHECK();
+	int nError;
+	sqlite3_stmt *stmt;
+	sqlite3_stmt *update_stmt = NULL;
+	int moved = 0;
+	int ret = FAVORITES_ERROR_NONE;
 
 	if (_favorites_open_bookmark_db() < 0) {
 		FAVORITES_LOGE("db_util_open is failed\n");
 		return FAVORITES_ERROR_DB_FAILED;
 	}
+	if (_favorites_db_exec(gl_internet_bookmark_db, "begin immediate") < 0) {
+		_favorites_close_bookmark_db();
+		return FAVORITES_ERROR_DB_FAILED;
+	}
 
 	nError = sqlite3_prepare_v2(gl_internet_bookmark_db,
-			query, -1, &stmt, NULL);
+			"select id, favicon, favicon_length, favicon_w, favicon_h from bookmarks\
+			where favicon is not null and favicon_length > 0", -1, &stmt, NULL);
+	if (nError == SQLITE_OK) {
+		nError = sqlite3_prepare_v2(gl_internet_bookmark_db,
+				"update bookmarks set favicon_id=?, favicon=NULL, favicon_length=0\
+				where id=?", -1, &update_stmt, NULL);
+	}
 	if (nError != SQLITE_OK) {
 		FAVORITES_LOGE("sqlite3_prepare_v2 is failed(%s).\n",
 			sqlite3_errmsg(gl_internet_bookmark_db));
-		_favorites_finalize_bookmark_db(stmt);
+		ret = FAVORITES_ERROR_DB_FAILED;
+	}
+
+	/* Only the favicon columns of visited rows change, so updating the
+	 * table while stepping through it is safe. */
+	while (ret == FAVORITES_ERROR_NONE
+			&& (nError = sqlite3_step(stmt)) == SQLITE_ROW) {
+		int length = sqlite3_column_int(stmt, 2);
+		sqlite3_int64 favicon_id;
+
+		if (sqlite3_column_bytes(stmt, 1) < length)
+			continue;
+		favicon_id = _favorites_bookmark_get_favicon_id(
+				sqlite3_column_blob(stmt, 1), length,
+				sqlite3_column_int(stmt, 3), sqlite3_column_int(stmt, 4));
+		if (favicon_id < 0) {
+			ret = FAVORITES_ERROR_DB_FAILED;
+			break;
+		}
+		sqlite3_bind_int64(update_stmt, 1, favicon_id);
+		sqlite3_bind_int(update_stmt, 2, sqlite3_column_int(stmt, 0));
+		if (sqlite3_step(update_stmt) != SQLITE_DONE) {
+			FAVORITES_LOGE("sqlite3_step is failed");
+			ret = FAVORITES_ERROR_DB_FAILED;
+		}
+		sqlite3_reset(update_stmt);
+		moved++;
+	}
+	sqlite3_finalize(stmt);
+	sqlite3_finalize(update_stmt);
+
+	/* shared favicons stored before variants existed */
+	if (ret == FAVORITES_ERROR_NONE) {
+		nError = sqlite3_prepare_v2(gl_internet_bookmark_db,
+				"select f.id, f.data, f.length, f.w, f.h from favicons f\
+				where (f.w > ?1 or f.h > ?1) and not exists\
+				(select 1 from favicon_variants v where v.favicon_id=f.id)",
+				-1, &stmt, NULL);
+		if (nError != SQLITE_OK) {
+			FAVORITES_LOGE("sqlite3_prepare_v2 is failed.\n");
+			ret = FAVORITES_ERROR_DB_FAILED;
+		} else {
+			sqlite3_bind_int(stmt, 1, gl_favicon_variant_sizes[0]);
+		}
+		while (ret == FAVORITES_ERROR_NONE
+				&& (nError = sqlite3_step(stmt)) == SQLITE_ROW) {
+			int length = sqlite3_column_int(stmt, 2);
+
+			if (sqlite3_column_bytes(stmt, 1) < length)
+				continue;
+			if (_favorites_bookmark_add_favicon_variants(
+					sqlite3_column_int64(stmt, 0),
+					sqlite3_column_blob(stmt, 1), length,
+					sqlite3_column_int(stmt, 3),
+					sqlite3_column_int(stmt, 4)) < 0)
+				ret = FAVORITES_ERROR_DB_FAILED;
+		}
+		sqlite3_finalize(stmt);
+	}
+
+	if (ret == FAVORITES_ERROR_NONE
+			&& _favorites_db_exec(gl_internet_bookmark_db, "commit") < 0)
+		ret = FAVORITES_ERROR_DB_FAILED;
+	if (ret != FAVORITES_ERROR_NONE) {
+		sqlite3_exec(gl_internet_bookmark_db, "rollback", NULL, NULL, NULL);
+		moved = 0;
+	}
+	_favorites_close_bookmark_db();
+
+	if (moved > 0) {
+		_favorites_bookmark_cache_invalidate();
+		_favorites_favicon_cache_invalidate(-1);
+	}
+	if (moved_count != NULL)
+		*moved_count = moved;
+	return ret;
+}
+
+int favorites_bookmark_add_folder(const char *title, int parent_id, int *folder_id)
+{
+	FAVORITES_API_ENTER();
+	FAVORITES_WRITABLE_CHECK();
+	FAVORITES_INVALID_ARG_CHECK(parent_id<=0);
+	int nError;
+	int ret = FAVORITES_ERROR_NONE;
+	int type, parent, sequence;
+	int id = 0;
+
+	if (!title || (strlen(title) <= 0)) {
+		FAVORITES_LOGE("title is empty\n");
+		return FAVORITES_ERROR_INVALID_PARAMETER;
+	}
+
+	if (_favorites_open_bookmark_db() < 0) {
+		FAVORITES_LOGE("db_util_open is failed\n");
+		return FAVORITES_ERROR_DB_FAILED;
+	}
+	/* the parent, the title check and the insert are seen by one writer */
+	if (_favorites_db_exec(gl_internet_bookmark_db, "begin immediate") < 0) {
+		_favorites_close_bookmark_db();
 		return FAVORITES_ERROR_DB_FAILED;
 	}
 
-	nError = sqlite3_step(stmt);
-	if (nError == SQLITE_ROW) {
-		favicon = (favicon_entry_h) calloc(1, sizeof(favicon_entry_s));
-		/* loading favicon from bookmark db */
-		favicon_data_temp = (void *)sqlite3_column_blob(stmt,0);
-		favicon->length = sqlite3_column_int(stmt,1);
-		favicon->w = sqlite3_column_int(stmt,2);
-		favicon->h = sqlite3_column_int(stmt,3);
-
-		if (favicon->length > 0){
-			favicon->data = calloc(1, favicon->length);
-			memcpy(favicon->data, favicon_data_temp, favicon->length);
-			/* transforming to evas object */
-			*icon = evas_object_image_filled_add(evas);
-			evas_object_image_colorspace_set(*icon,
-							EVAS_COLORSPACE_ARGB8888);
-			evas_object_image_size_set(*icon, favicon->w, favicon->h);
-			evas_object_image_fill_set(*icon, 0, 0, favicon->w,
-									favicon->h);
-			evas_object_image_filled_set(*icon, EINA_TRUE);
-			evas_object_image_alpha_set(*icon,EINA_TRUE);
-			evas_object_image_data_set(*icon, favicon->data);
+	nError = _favorites_bookmark_get_position(parent_id, &type, &parent, &sequence);
+	if (nError <= 0 || type != 1) {
+		ret = nError < 0 ? FAVORITES_ERROR_DB_FAILED : FAVORITES_ERROR_INVALID_PARAMETER;
+	} else {
+		/* titles are unique among the folders of one parent */
+		id = _favorites_bookmark_find_folder(title, parent_id);
+		if (id > 0) {
+			FAVORITES_LOGW("The folder is already exist.\n");
+			ret = FAVORITES_ERROR_ITEM_ALREADY_EXIST;
+		} else if (id == 0) {
+			id = _favorites_bookmark_insert_folder(title, parent_id);
 		}
-		_favorites_finalize_bookmark_db(stmt);
-		return FAVORITES_ERROR_NONE;
+		if (id < 0)
+			ret = FAVORITES_ERROR_DB_FAILED;
 	}
 
+	if (ret != FAVORITES_ERROR_NONE
+			|| _favorites_db_exec(gl_internet_bookmark_db, "commit") < 0) {
+		sqlite3_exec(gl_internet_bookmark_db, "rollback", NULL, NULL, NULL);
+		if (ret == FAVORITES_ERROR_NONE)
+			ret = FAVORITES_ERROR_DB_FAILED;
+	}
 	_favorites_close_bookmark_db();
+	if (ret != FAVORITES_ERROR_NONE)
+		return ret;
+
+	_favorites_bookmark_cache_invalidate();
+	if (folder_id != NULL)
+		*folder_id = id;
 	return FAVORITES_ERROR_NONE;
 }
 
+int favorites_bookmark_move(int bookmark_id, int folder_id, int before_id)
+{
+	FAVORITES_API_ENTER();
+	FAVORITES_WRITABLE_CHECK();
+	FAVORITES_INVALID_ARG_CHECK(bookmark_id<=0);
+	FAVORITES_INVALID_ARG_CHECK(folder_id<=0);
+	int nError;
+	int ret = FAVORITES_ERROR_NONE;
+	int type, parent, sequence;
+	int folder_type, folder_parent, folder_sequence;
+	int before_parent, before_sequence = 0;
+	sqlite3_stmt *stmt;
+
+	if (bookmark_id == folder_id || bookmark_id == before_id)
+		return FAVORITES_ERROR_INVALID_PARAMETER;
+
+	if (_favorites_open_bookmark_db() < 0) {
+		FAVORITES_LOGE("db_util_open is failed\n");
+		return FAVORITES_ERROR_DB_FAILED;
+	}
+	if (_favorites_db_exec(gl_internet_bookmark_db, "begin immediate") < 0) {
+		_favorites_close_bookmark_db();
+		return FAVORITES_ERROR_DB_FAILED;
+	}
+
+	nError = _favorites_bookmark_get_position(bookmark_id, &type, &parent, &sequence);
+	if (nError < 0)
+		ret = FAVORITES_ERROR_DB_FAILED;
+	else if (nError == 0 || parent == 0)
+		ret = FAVORITES_ERROR_INVALID_PARAMETER;
+
+	if (ret == FAVORITES_ERROR_NONE) {
+		nError = _favorites_bookmark_get_position(folder_id,
+				&folder_type, &folder_parent, &folder_sequence);
+		if (nError < 0)
+			ret = FAVORITES_ERROR_DB_FAILED;
+		else if (nError == 0 || folder_type != 1)
+			ret = FAVORITES_ERROR_INVALID_PARAMETER;
+	}
+
+	/* a folder cannot go below itself */
+	if (ret == FAVORITES_ERROR_NONE && type == 1 && folder_id != parent) {
+		nError = _favorites_bookmark_is_in_subtree(folder_id, bookmark_id);
+		if (nError < 0)
+			ret = FAVORITES_ERROR_DB_FAILED;
+		else if (nError > 0)
+			ret = FAVORITES_ERROR_INVALID_PARAMETER;
+	}
+
+	if (ret == FAVORITES_ERROR_NONE && before_id > 0) {
+		nError = _favorites_bookmark_get_position(before_id,
+				&folder_type, &before_parent, &before_sequence);
+		if (nError < 0)
+			ret = FAVORITES_ERROR_DB_FAILED;
+		else if (nError == 0 || before_parent != folder_id)
+			ret = FAVORITES_ERROR_INVALID_PARAMETER;
+	}
+
+	if (ret == FAVORITES_ERROR_NONE) {
+		if (before_id > 0)
+			sequence = _favorites_bookmark_sequence_before(folder_id,
+					bookmark_id, before_id, before_sequence);
+		else
+			sequence = _favorites_bookmark_next_sequence(folder_id, bookmark_id);
+		if (sequence == -1)
+			ret = FAVORITES_ERROR_DB_FAILED;
+	}
+
+	if (ret == FAVORITES_ERROR_NONE) {
+		nError = sqlite3_prepare_v2(gl_internet_bookmark_db,
+				"update bookmarks set parent=?, sequence=?,\
+				updatedate=DATETIME('now') where id=?", -1, &stmt, NULL);
+		if (nError != SQLITE_OK) {
+			FAVORITES_LOGE("sqlite3_prepare_v2 is failed.\n");
+			ret = FAVORITES_ERROR_DB_FAILED;
+		} else if (sqlite3_bind_int(stmt, 1, folder_id) != SQLITE_OK
+				|| sqlite3_bind_int(stmt, 2, sequence) != SQLITE_OK
+				|| sqlite3_bind_int(stmt, 3, bookmark_id) != SQLITE_OK
+				|| sqlite3_step(stmt) != SQLITE_DONE) {
+			FAVORITES_LOGE("sqlite3_step is failed");
+			ret = FAVORITES_ERROR_DB_FAILED;
+		}
+		sqlite3_finalize(stmt);
+	}
+
+	if (ret == FAVORITES_ERROR_NONE
+			&& _favorites_db_exec(gl_internet_bookmark_db, "commit") < 0)
+		ret = FAVORITES_ERROR_DB_FAILED;
+	if (ret != FAVORITES_ERROR_NONE)
+		sqlite3_exec(gl_internet_bookmark_db, "rollback", NULL, NULL, NULL);
+	_favorites_close_bookmark_db();
+
+	if (ret == FAVORITES_ERROR_NONE)
+		_favorites_bookmark_cache_invalidate();
+	return ret;
+}
+
+int favorites_bookmark_update(int bookmark_id, int field_mask, const favorites_bookmark_entry_s *values)
+{
+	FAVORITES_API_ENTER();
+	FAVORITES_WRITABLE_CHECK();
+	FAVORITES_INVALID_ARG_CHECK(bookmark_id<=0);
+	FAVORITES_NULL_ARG_CHECK(values);
+	int nError;
+	int type, parent, sequence;
+	int changed;
+	sqlite3_stmt *stmt;
+	char	query[512];
+	char	condition[128];
+	const int all_fields = FAVORITES_BOOKMARK_FIELD_TITLE
+		| FAVORITES_BOOKMARK_FIELD_ADDRESS | FAVORITES_BOOKMARK_FIELD_EDITABLE;
+
+	if (field_mask == 0 || (field_mask & ~all_fields) != 0) {
+		FAVORITES_LOGE("invalid field mask 0x%x\n", field_mask);
+		return FAVORITES_ERROR_INVALID_PARAMETER;
+	}
+	if ((field_mask & FAVORITES_BOOKMARK_FIELD_TITLE)
+			&& (!values->title || (strlen(values->title) <= 0))) {
+		FAVORITES_LOGE("title is empty\n");
+		return FAVORITES_ERROR_INVALID_PARAMETER;
+	}
+	if ((field_mask & FAVORITES_BOOKMARK_FIELD_ADDRESS)
+			&& (!values->address || (strlen(values->address) <= 0))) {
+		FAVORITES_LOGE("url is empty\n");
+		return FAVORITES_ERROR_INVALID_PARAMETER;
+	}
+
+	/* Only the requested columns are written, and the row is left alone
+	 * (update date and change counters included) when none of them
+	 * differs. Parameters: 1 title, 2 address, 3 url_hash, 4 editable,
+	 * 5 id. */
+	strcpy(query, "update bookmarks set updatedate=DATETIME('now')");
+	strcpy(condition, "0");
+	if (field_mask & FAVORITES_BOOKMARK_FIELD_TITLE) {
+		strcat(query, ", title=?1");
+		strcat(condition, " or title is not ?1");
+	}
+	if (field_mask & FAVORITES_BOOKMARK_FIELD_ADDRESS) {
+		strcat(query, ", address=?2, url_hash=?3");
+		strcat(condition, " or address is not ?2");
+	}
+	if (field_mask & FAVORITES_BOOKMARK_FIELD_EDITABLE) {
+		strcat(query, ", editable=?4");
+		strcat(condition, " or editable is not ?4");
+	}
+	strcat(query, " where id=?5 and parent != 0 and (");
+	strcat(query, condition);
+	strcat(query, ")");
+
+	if (_favorites_open_bookmark_db() < 0) {
+		FAVORITES_LOGE("db_util_open is failed\n");
+		return FAVORITES_ERROR_DB_FAILED;
+	}
+
+	nError = _favorites_bookmark_get_position(bookmark_id, &type, &parent, &sequence);
+	if (nError <= 0 || parent == 0
+			|| (type == 1 && (field_mask & FAVORITES_BOOKMARK_FIELD_ADDRESS))) {
+		_favorites_close_bookmark_db();
+		return nError < 0 ? FAVORITES_ERROR_DB_FAILED : FAVORITES_ERROR_INVALID_PARAMETER;
+	}
+
+	nError = sqlite3_prepare_v2(gl_internet_bookmark_db, query, -1, &stmt, NULL);
+	if (nError != SQLITE_OK) {
+		FAVORITES_LOGE("sqlite3_prepare_v2 is failed(%s).\n",
+			sqlite3_errmsg(gl_internet_bookmark_db));
+		_favorites_finalize_bookmark_db(stmt);
+		return FAVORITES_ERROR_DB_FAILED;
+	}
+	if (((field_mask & FAVORITES_BOOKMARK_FIELD_TITLE)
+				&& sqlite3_bind_text(stmt, 1, values->title, -1, NULL) != SQLITE_OK)
+			|| ((field_mask & FAVORITES_BOOKMARK_FIELD_ADDRESS)
+				&& (sqlite3_bind_text(stmt, 2, values->address, -1, NULL) != SQLITE_OK
+				|| sqlite3_bind_int64(stmt, 3,
+					_favorites_db_url_hash(values->address)) != SQLITE_OK))
+			|| ((field_mask & FAVORITES_BOOKMARK_FIELD_EDITABLE)
+				&& sqlite3_bind_int(stmt, 4, values->editable ? 1 : 0) != SQLITE_OK)
+			|| sqlite3_bind_int(stmt, 5, bookmark_id) != SQLITE_OK) {
+		FAVORITES_LOGE("sqlite3_bind is failed");
+		_favorites_finalize_bookmark_db(stmt);
+		return FAVORITES_ERROR_DB_FAILED;
+	}
+
+	nError = sqlite3_step(stmt);
+	if (nError == SQLITE_OK || nError == SQLITE_DONE) {
+		changed = sqlite3_changes(gl_internet_bookmark_db);
+		_favorites_finalize_bookmark_db(stmt);
+		if (changed > 0) {
+			_favorites_bookmark_cache_invalidate();
+			if (type == 1)
+				_favorites_bookmark_folder_cache_remove(bookmark_id);
+			if (field_mask & FAVORITES_BOOKMARK_FIELD_ADDRESS)
+				_favorites_url_filter_add(_favorites_db_url_hash(values->address));
+		}
+		return FAVORITES_ERROR_NONE;
+	}
+	FAVORITES_LOGE("sqlite3_step is failed");
+	_favorites_finalize_bookmark_db(stmt);
+	return FAVORITES_ERROR_DB_FAILED;
+}
+
 int favorites_bookmark_delete_bookmark(int id)
 {
-	FAVORITES_INVALID_ARG_CHECK(id<0);
+	FAVORITES_API_ENTER();
+	FAVORITES_WRITABLE_CHECK();
+	FAVORITES_INVALID_ARG_CHECK(id<=0);
+	/* the root folder is never deleted */
+	FAVORITES_INVALID_ARG_CHECK(id==1);
 	int nError;
 	sqlite3_stmt *stmt;
 
@@ -1098,7 +2596,35 @@ int favorites_bookmark_delete_bookmark(int id)
 	}
 
 	nError = sqlite3_prepare_v2(gl_internet_bookmark_db,
-			        "delete from bookmarks where id=? and parent != 0", -1, &stmt, NULL);
+			        "select parent from bookmarks where id=?", -1, &stmt, NULL);
+	if (nError != SQLITE_OK) {
+		FAVORITES_LOGE("sqlite3_prepare_v2 is failed.\n");
+		_favorites_finalize_bookmark_db(stmt);
+		return FAVORITES_ERROR_DB_FAILED;
+	}
+	if (sqlite3_bind_int(stmt, 1, id) != SQLITE_OK) {
+		FAVORITES_LOGE("sqlite3_bind_int is failed");
+		_favorites_finalize_bookmark_db(stmt);
+		return FAVORITES_ERROR_DB_FAILED;
+	}
+	nError = sqlite3_step(stmt);
+	if (nError != SQLITE_ROW || sqlite3_column_int(stmt, 0) == 0) {
+		/* nothing to delete, or a root item */
+		_favorites_finalize_bookmark_db(stmt);
+		if (nError == SQLITE_ROW)
+			return FAVORITES_ERROR_INVALID_PARAMETER;
+		return nError == SQLITE_DONE ? FAVORITES_ERROR_NONE : FAVORITES_ERROR_DB_FAILED;
+	}
+	sqlite3_finalize(stmt);
+
+	/* a folder goes together with everything below it. The walk starts
+	 * from the row itself, so that it never reaches the root. */
+	nError = sqlite3_prepare_v2(gl_internet_bookmark_db,
+			        "delete from bookmarks where parent != 0 and id in\
+			        (with recursive subtree(id) as\
+			        (select id from bookmarks where id=?1 and parent != 0\
+			        union select b.id from bookmarks b, subtree s where b.parent=s.id)\
+			        select id from subtree)", -1, &stmt, NULL);
 	if (nError != SQLITE_OK) {
 		FAVORITES_LOGE("sqlite3_prepare_v2 is failed.\n");
 		_favorites_finalize_bookmark_db(stmt);
@@ -1112,7 +2638,11 @@ int favorites_bookmark_delete_bookmark(int id)
 	}
 	nError = sqlite3_step(stmt);
 	if (nError == SQLITE_OK || nError == SQLITE_DONE) {
+		int deleted = sqlite3_changes(gl_internet_bookmark_db);
 		_favorites_finalize_bookmark_db(stmt);
+		_favorites_bookmark_cache_invalidate();
+		_favorites_bookmark_folder_cache_remove(deleted > 1 ? -1 : id);
+		_favorites_favicon_cache_invalidate(deleted > 1 ? -1 : id);
 		return FAVORITES_ERROR_NONE;
 	}
 	FAVORITES_LOGE("sqlite3_step is failed");
@@ -1122,6 +2652,8 @@ int favorites_bookmark_delete_bookmark(int id)
 
 int favorites_bookmark_delete_all_bookmarks(void)
 {
+	FAVORITES_API_ENTER();
+	FAVORITES_WRITABLE_CHECK();
 	int nError;
 	sqlite3_stmt *stmt;
 
@@ -1140,6 +2672,9 @@ int favorites_bookmark_delete_all_bookmarks(void)
 	nError = sqlite3_step(stmt);
 	if (nError == SQLITE_OK || nError == SQLITE_DONE) {
 		_favorites_finalize_bookmark_db(stmt);
+		_favorites_bookmark_cache_invalidate();
+		_favorites_bookmark_folder_cache_remove(-1);
+		_favorites_favicon_cache_invalidate(-1);
 		return FAVORITES_ERROR_NONE;
 	}
 	FAVORITES_LOGE("sqlite3_step is failed");
@@ -0,0 +1,452 @@
+/*
+ * Copyright (c) 2011 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <dlog.h>
+#include <db-util.h>
+#include <favorites.h>
+#include <favorites_private.h>
+
+extern __thread sqlite3 *gl_internet_bookmark_db;
+
+/*
+ * In-process snapshot of the bookmarks table (every row with parent != 0,
+ * ordered by sequence). A snapshot is immutable once built; readers take a
+ * reference and iterate it without holding the lock, so callbacks may call
+ * back into this library.
+ */
+struct bookmark_cache_snapshot {
+	bookmark_list_s list;	/* must be the first member */
+	sqlite3_int64 version;
+	int refcount;
+};
+typedef struct bookmark_cache_snapshot bookmark_cache_snapshot_s;
+
+static pthread_mutex_t gl_bookmark_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static bookmark_cache_snapshot_s *gl_bookmark_cache = NULL;
+static int gl_bookmark_cache_enabled = 0;
+
+/* Connection kept open for the version check, so that a cache hit opens
+ * nothing. It is shared by all threads under its own lock, and left alone
+ * in a forked child, which opens its own. */
+static pthread_mutex_t gl_bookmark_cache_db_lock = PTHREAD_MUTEX_INITIALIZER;
+static sqlite3 *gl_bookmark_cache_db = NULL;
+static sqlite3_stmt *gl_bookmark_cache_version_stmt = NULL;
+static pid_t gl_bookmark_cache_db_pid = 0;
+
+static char *_favorites_bookmark_cache_strdup(const unsigned char *text)
+{
+	/* empty strings are reported as NULL like the db paths do */
+	if (text == NULL || text[0] == '\0')
+		return NULL;
+	return strdup((const char *)text);
+}
+
+static void _favorites_bookmark_cache_unref(bookmark_cache_snapshot_s *snapshot)
+{
+	if (snapshot == NULL)
+		return;
+	if (--snapshot->refcount > 0)
+		return;
+	/* _favorites_free_bookmark_list() frees the list struct itself,
+	 * which is the snapshot */
+	_favorites_free_bookmark_list(&snapshot->list);
+}
+
+static bookmark_cache_snapshot_s *_favorites_bookmark_cache_build(sqlite3_int64 version)
+{
+	bookmark_cache_snapshot_s *snapshot;
+	int nError;
+	int capacity = 64;
+	sqlite3_stmt *stmt;
+
+	nError = sqlite3_prepare_v2(gl_internet_bookmark_db,
+			"select id, type, parent, address, title, editable,\
+			creationdate, updatedate, sequence \
+			from bookmarks where parent != 0 order by sequence, id",
+			-1, &stmt, NULL);
+	if (nError != SQLITE_OK) {
+		FAVORITES_LOGE("sqlite3_prepare_v2 is failed.\n");
+		sqlite3_finalize(stmt);
+		return NULL;
+	}
+
+	snapshot = (bookmark_cache_snapshot_s *)calloc(1, sizeof(bookmark_cache_snapshot_s));
+	if (snapshot == NULL) {
+		sqlite3_finalize(stmt);
+		return NULL;
+	}
+	snapshot->version = version;
+	snapshot->refcount = 1;
+	snapshot->list.item = (bookmark_entry_internal_h)calloc(capacity,
+			sizeof(bookmark_entry_internal_s));
+
+	while (snapshot->list.item != NULL
+			&& (nError = sqlite3_step(stmt)) == SQLITE_ROW) {
+		bookmark_entry_internal_h item;
+
+		if (snapshot->list.count == capacity) {
+			bookmark_entry_internal_h grown = (bookmark_entry_internal_h)realloc(
+					snapshot->list.item,
+					capacity * 2 * sizeof(bookmark_entry_internal_s));
+			if (grown == NULL)
+				break;
+			memset(grown + capacity, 0x00, capacity * sizeof(bookmark_entry_internal_s));
+			snapshot->list.item = grown;
+			capacity *= 2;
+		}
+		item = &snapshot->list.item[snapshot->list.count];
+		item->id = sqlite3_column_int(stmt, 0);
+		item->is_folder = sqlite3_column_int(stmt, 1);
+		item->folder_id = sqlite3_column_int(stmt, 2);
+		if (!item->is_folder)
+			item->address = _favorites_bookmark_cache_strdup(sqlite3_column_text(stmt, 3));
+		item->title = _favorites_bookmark_cache_strdup(sqlite3_column_text(stmt, 4));
+		item->editable = sqlite3_column_int(stmt, 5);
+		item->creationdate = _favorites_bookmark_cache_strdup(sqlite3_column_text(stmt, 6));
+		item->updatedate = _favorites_bookmark_cache_strdup(sqlite3_column_text(stmt, 7));
+		item->orderIndex = sqlite3_column_int(stmt, 8);
+		snapshot->list.count++;
+	}
+	sqlite3_finalize(stmt);
+
+	if (nError != SQLITE_DONE) {
+		FAVORITES_LOGE("building bookmark cache is failed");
+		_favorites_free_bookmark_list(&snapshot->list);
+		return NULL;
+	}
+	return snapshot;
+}
+
+/* Called with gl_bookmark_cache_db_lock held */
+static void _favorites_bookmark_cache_db_close(void)
+{
+	if (gl_bookmark_cache_db_pid == getpid()) {
+		sqlite3_finalize(gl_bookmark_cache_version_stmt);
+		db_util_close(gl_bookmark_cache_db);
+	}
+	gl_bookmark_cache_version_stmt = NULL;
+	gl_bookmark_cache_db = NULL;
+}
+
+/* Called with gl_bookmark_cache_db_lock held. The bookmark db is opened
+ * once first, so that its schema is up to date. */
+static int _favorites_bookmark_cache_db_open(void)
+{
+	if (gl_bookmark_cache_db != NULL && gl_bookmark_cache_db_pid == getpid())
+		return 0;
+	_favorites_bookmark_cache_db_close();
+
+	if (_favorites_open_bookmark_db() < 0) {
+		FAVORITES_LOGE("db_util_open is failed\n");
+		return -1;
+	}
+	_favorites_close_bookmark_db();
+
+	if (_favorites_db_open(_favorites_get_bookmark_db_name(),
+			&gl_bookmark_cache_db) != SQLITE_OK) {
+		FAVORITES_LOGE("db_util_open is failed\n");
+		db_util_close(gl_bookmark_cache_db);
+		gl_bookmark_cache_db = NULL;
+		return -1;
+	}
+	gl_bookmark_cache_db_pid = getpid();
+	if (sqlite3_prepare_v2(gl_bookmark_cache_db,
+			"select value from favorites_meta where name='bookmarks_version'",
+			-1, &gl_bookmark_cache_version_stmt, NULL) != SQLITE_OK) {
+		FAVORITES_LOGE("sqlite3_prepare_v2 is failed.\n");
+		_favorites_bookmark_cache_db_close();
+		return -1;
+	}
+	return 0;
+}
+
+/* Reads bookmarks_version on the long-lived connection */
+static int _favorites_bookmark_cache_version(sqlite3_int64 *version)
+{
+	int nError;
+	int ret = -1;
+
+	pthread_mutex_lock(&gl_bookmark_cache_db_lock);
+	if (_favorites_bookmark_cache_db_open() == 0) {
+		/* lock waits are accounted to the public function being called */
+		_favorites_db_set_busy_handler(gl_bookmark_cache_db, FAVORITES_API_NAME);
+		nError = sqlite3_step(gl_bookmark_cache_version_stmt);
+		if (nError == SQLITE_ROW) {
+			*version = sqlite3_column_int64(gl_bookmark_cache_version_stmt, 0);
+			ret = 0;
+		}
+		sqlite3_reset(gl_bookmark_cache_version_stmt);
+		if (ret < 0) {
+			FAVORITES_LOGE("reading bookmarks_version is failed(%d)", nError);
+			_favorites_bookmark_cache_db_close();
+		}
+	}
+	pthread_mutex_unlock(&gl_bookmark_cache_db_lock);
+	return ret;
+}
+
+/* Returns a reference to an up-to-date snapshot, or NULL when the cache is
+ * disabled or unusable; callers then read the db directly. */
+bookmark_list_h _favorites_bookmark_cache_acquire(void)
+{
+	bookmark_cache_snapshot_s *snapshot = NULL;
+	sqlite3_int64 version;
+
+	if (!gl_bookmark_cache_enabled)
+		return NULL;
+
+	if (_favorites_bookmark_cache_version(&version) < 0)
+		return NULL;
+
+	pthread_mutex_lock(&gl_bookmark_cache_lock);
+	if (gl_bookmark_cache != NULL && gl_bookmark_cache->version == version) {
+		snapshot = gl_bookmark_cache;
+		snapshot->refcount++;
+	}
+	pthread_mutex_unlock(&gl_bookmark_cache_lock);
+
+	if (snapshot != NULL)
+		return &snapshot->list;
+
+	/* The version is read before the rows, so a concurrent change can only
+	 * make this snapshot look older than it is, never newer. */
+	if (_favorites_open_bookmark_db() < 0) {
+		FAVORITES_LOGE("db_util_open is failed\n");
+		return NULL;
+	}
+	FAVORITES_TRACE_BEGIN(FAVORITES_TRACE_LEVEL_DEBUG, trace_start);
+	snapshot = _favorites_bookmark_cache_build(version);
+	FAVORITES_TRACE_END(trace_start, "cache build", snapshot ? snapshot->list.count : -1);
+	_favorites_close_bookmark_db();
+	if (snapshot == NULL)
+		return NULL;
+
+	pthread_mutex_lock(&gl_bookmark_cache_lock);
+	if (gl_bookmark_cache_enabled) {
+		_favorites_bookmark_cache_unref(gl_bookmark_cache);
+		gl_bookmark_cache = snapshot;
+		snapshot->refcount++;
+	}
+	pthread_mutex_unlock(&gl_bookmark_cache_lock);
+
+	return &snapshot->list;
+}
+
+void _favorites_bookmark_cache_release(bookmark_list_h list)
+{
+	if (list == NULL)
+		return;
+	pthread_mutex_lock(&gl_bookmark_cache_lock);
+	_favorites_bookmark_cache_unref((bookmark_cache_snapshot_s *)list);
+	pthread_mutex_unlock(&gl_bookmark_cache_lock);
+}
+
+/* Called after every write made through this library, with the db closed */
+void _favorites_bookmark_cache_invalidate(void)
+{
+	pthread_mutex_lock(&gl_bookmark_cache_lock);
+	_favorites_bookmark_cache_unref(gl_bookmark_cache);
+	gl_bookmark_cache = NULL;
+	pthread_mutex_unlock(&gl_bookmark_cache_lock);
+	_favorites_bookmark_snapshot_refresh();
+}
+
+/* Number of entries matching is_folder and folder_id (-1 matches any parent) */
+int _favorites_bookmark_cache_count(bookmark_list_h list, int is_folder, int folder_id)
+{
+	int i;
+	int count = 0;
+
+	for (i = 0; i < list->count; i++) {
+		if (list->item[i].is_folder == is_folder
+				&& (folder_id < 0 || list->item[i].folder_id == folder_id))
+			count++;
+	}
+	return count;
+}
+
+/* Deep copy of the entries matching is_folder and folder_id, in snapshot
+ * order. Freed with _favorites_free_bookmark_list(). */
+bookmark_list_h _favorites_bookmark_cache_filter(bookmark_list_h list,
+		int is_folder, int folder_id)
+{
+	bookmark_list_h m_list;
+	int i;
+	int count = _favorites_bookmark_cache_count(list, is_folder, folder_id);
+
+	if (count == 0)
+		return NULL;
+
+	m_list = (bookmark_list_h) calloc(1, sizeof(bookmark_list_s));
+	if (m_list == NULL)
+		return NULL;
+	m_list->item = (bookmark_entry_internal_h) calloc(count, sizeof(bookmark_entry_internal_s));
+	if (m_list->item == NULL) {
+		free(m_list);
+		return NULL;
+	}
+	for (i = 0; i < list->count && m_list->count < count; i++) {
+		bookmark_entry_internal_h src = &list->item[i];
+		bookmark_entry_internal_h dst = &m_list->item[m_list->count];
+
+		if (src->is_folder != is_folder
+				|| (folder_id >= 0 && src->folder_id != folder_id))
+			continue;
+		*dst = *src;
+		dst->address = _FAVORITES_STRDUP(src->address);
+		dst->title = _FAVORITES_STRDUP(src->title);
+		dst->creationdate = _FAVORITES_STRDUP(src->creationdate);
+		dst->updatedate = _FAVORITES_STRDUP(src->updatedate);
+		dst->visitdate = NULL;
+		m_list->count++;
+	}
+	return m_list;
+}
+
+/*
+ * Folder (parent, name) to id map used when adding bookmarks to a named
+ * folder, titles being unique among the folders of one parent. It is
+ * tagged with the folders_version it was filled at and forgotten as soon
+ * as the db reports another one.
+ */
+#define FOLDER_CACHE_BUCKETS	64
+
+struct folder_cache_entry {
+	char *title;
+	int parent_id;
+	int id;
+	struct folder_cache_entry *next;
+};
+typedef struct folder_cache_entry folder_cache_entry_s;
+
+static pthread_mutex_t gl_folder_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static folder_cache_entry_s *gl_folder_cache_table[FOLDER_CACHE_BUCKETS];
+static sqlite3_int64 gl_folder_cache_version = -1;
+
+static unsigned int _favorites_bookmark_folder_cache_hash(int parent_id, const char *title)
+{
+	unsigned int hash = 5381 + (unsigned int)parent_id;
+
+	while (*title)
+		hash = hash * 33 + (unsigned char)*title++;
+	return hash % FOLDER_CACHE_BUCKETS;
+}
+
+static void _favorites_bookmark_folder_cache_clear(void)
+{
+	int i;
+	folder_cache_entry_s *entry;
+
+	for (i = 0; i < FOLDER_CACHE_BUCKETS; i++) {
+		while ((entry = gl_folder_cache_table[i]) != NULL) {
+			gl_folder_cache_table[i] = entry->next;
+			free(entry->title);
+			free(entry);
+		}
+	}
+}
+
+/* Returns the cached folder id, 0 if unknown at this version */
+int _favorites_bookmark_folder_cache_lookup(sqlite3_int64 version, int parent_id,
+		const char *title)
+{
+	folder_cache_entry_s *entry;
+	int id = 0;
+
+	pthread_mutex_lock(&gl_folder_cache_lock);
+	if (version != gl_folder_cache_version) {
+		_favorites_bookmark_folder_cache_clear();
+		gl_folder_cache_version = version;
+	}
+	for (entry = gl_folder_cache_table[_favorites_bookmark_folder_cache_hash(parent_id, title)];
+			entry != NULL; entry = entry->next) {
+		if (entry->parent_id == parent_id && !strcmp(entry->title, title)) {
+			id = entry->id;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&gl_folder_cache_lock);
+	return id;
+}
+
+void _favorites_bookmark_folder_cache_insert(sqlite3_int64 version, int parent_id,
+		const char *title, int id)
+{
+	folder_cache_entry_s *entry;
+	unsigned int bucket = _favorites_bookmark_folder_cache_hash(parent_id, title);
+
+	pthread_mutex_lock(&gl_folder_cache_lock);
+	if (version != gl_folder_cache_version) {
+		_favorites_bookmark_folder_cache_clear();
+		gl_folder_cache_version = version;
+	}
+	entry = (folder_cache_entry_s *)calloc(1, sizeof(folder_cache_entry_s));
+	if (entry != NULL && (entry->title = strdup(title)) != NULL) {
+		entry->parent_id = parent_id;
+		entry->id = id;
+		entry->next = gl_folder_cache_table[bucket];
+		gl_folder_cache_table[bucket] = entry;
+	} else {
+		free(entry);
+	}
+	pthread_mutex_unlock(&gl_folder_cache_lock);
+}
+
+/* Forgets the folder with the given id, or every folder if id < 0 */
+void _favorites_bookmark_folder_cache_remove(int id)
+{
+	int i;
+	folder_cache_entry_s **slot;
+	folder_cache_entry_s *entry;
+
+	pthread_mutex_lock(&gl_folder_cache_lock);
+	for (i = 0; i < FOLDER_CACHE_BUCKETS; i++) {
+		slot = &gl_folder_cache_table[i];
+		while ((entry = *slot) != NULL) {
+			if (id < 0 || entry->id == id) {
+				*slot = entry->next;
+				free(entry->title);
+				free(entry);
+			} else {
+				slot = &entry->next;
+			}
+		}
+	}
+	pthread_mutex_unlock(&gl_folder_cache_lock);
+}
+
+/*************************************************************
+ *	APIs for Internet favorites
+ *************************************************************/
+int favorites_bookmark_set_cache_enabled(bool enabled)
+{
+	pthread_mutex_lock(&gl_bookmark_cache_lock);
+	gl_bookmark_cache_enabled = enabled ? 1 : 0;
+	if (!enabled) {
+		_favorites_bookmark_cache_unref(gl_bookmark_cache);
+		gl_bookmark_cache = NULL;
+	}
+	pthread_mutex_unlock(&gl_bookmark_cache_lock);
+	if (!enabled) {
+		pthread_mutex_lock(&gl_bookmark_cache_db_lock);
+		_favorites_bookmark_cache_db_close();
+		pthread_mutex_unlock(&gl_bookmark_cache_db_lock);
+	}
+	return FAVORITES_ERROR_NONE;
+}
@@ -0,0 +1,395 @@
+/*
+ * Copyright (c) 2011 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dlog.h>
+#include <db-util.h>
+#include <favorites.h>
+#include <favorites_private.h>
+
+/*
+ * Snapshot file layout, in host byte order:
+ *   header
+ *   record_count records, in favorites_bookmark_foreach_tree() order
+ *   string pool of string_size bytes, NUL terminated strings
+ * Strings are referenced by their offset in the pool, a missing string by
+ * SNAPSHOT_NO_STRING. Readers only check the header and then use the
+ * records in place.
+ */
+#define SNAPSHOT_MAGIC		"FAVSNAP"
+#define SNAPSHOT_FORMAT		1
+#define SNAPSHOT_BYTE_ORDER	0x01020304
+#define SNAPSHOT_NO_STRING	0xffffffff
+
+struct bookmark_snapshot_header {
+	char magic[8];
+	uint32_t format;
+	uint32_t byte_order;
+	int64_t version;	/* bookmarks_version the snapshot was made at */
+	uint32_t record_count;
+	uint32_t record_size;
+	uint32_t string_size;
+	uint32_t reserved;
+};
+typedef struct bookmark_snapshot_header bookmark_snapshot_header_s;
+
+struct bookmark_snapshot_record {
+	int32_t id;
+	int32_t folder_id;
+	int32_t order_index;
+	int32_t depth;
+	uint32_t address;
+	uint32_t title;
+	uint32_t creation_date;
+	uint32_t update_date;
+	uint8_t is_folder;
+	uint8_t editable;
+	uint8_t reserved[6];
+};
+typedef struct bookmark_snapshot_record bookmark_snapshot_record_s;
+
+struct favorites_bookmark_snapshot {
+	void *map;
+	size_t size;
+	const bookmark_snapshot_record_s *records;
+	uint32_t record_count;
+	const char *strings;
+	uint32_t string_size;
+};
+
+/* growable buffers filled by the tree walk */
+struct bookmark_snapshot_builder {
+	bookmark_snapshot_record_s *records;
+	uint32_t record_count;
+	uint32_t record_capacity;
+	char *strings;
+	uint32_t string_size;
+	uint32_t string_capacity;
+	int failed;
+};
+typedef struct bookmark_snapshot_builder bookmark_snapshot_builder_s;
+
+static pthread_mutex_t gl_bookmark_snapshot_lock = PTHREAD_MUTEX_INITIALIZER;
+static char *gl_bookmark_snapshot_path = NULL;
+
+static uint32_t _favorites_bookmark_snapshot_add_string(
+		bookmark_snapshot_builder_s *builder, const char *text)
+{
+	uint32_t offset = builder->string_size;
+	uint32_t length;
+
+	if (text == NULL)
+		return SNAPSHOT_NO_STRING;
+	length = strlen(text) + 1;
+	if (builder->string_size + length > builder->string_capacity) {
+		uint32_t capacity = builder->string_capacity ? builder->string_capacity : 4096;
+		char *grown;
+
+		while (builder->string_size + length > capacity)
+			capacity *= 2;
+		grown = (char *)realloc(builder->strings, capacity);
+		if (grown == NULL) {
+			builder->failed = 1;
+			return SNAPSHOT_NO_STRING;
+		}
+		builder->strings = grown;
+		builder->string_capacity = capacity;
+	}
+	memcpy(builder->strings + offset, text, length);
+	builder->string_size += length;
+	return offset;
+}
+
+static bool _favorites_bookmark_snapshot_add(favorites_bookmark_entry_s *item,
+		int depth, void *user_data)
+{
+	bookmark_snapshot_builder_s *builder = (bookmark_snapshot_builder_s *)user_data;
+	bookmark_snapshot_record_s *record;
+
+	if (builder->record_count == builder->record_capacity) {
+		uint32_t capacity = builder->record_capacity ? builder->record_capacity * 2 : 64;
+		bookmark_snapshot_record_s *grown = (bookmark_snapshot_record_s *)realloc(
+				builder->records, capacity * sizeof(bookmark_snapshot_record_s));
+		if (grown == NULL) {
+			builder->failed = 1;
+			return false;
+		}
+		builder->records = grown;
+		builder->record_capacity = capacity;
+	}
+	record = &builder->records[builder->record_count++];
+	memset(record, 0x00, sizeof(bookmark_snapshot_record_s));
+	record->id = item->id;
+	record->folder_id = item->folder_id;
+	record->order_index = item->order_index;
+	record->depth = depth;
+	record->is_folder = item->is_folder;
+	record->editable = item->editable;
+	record->address = _favorites_bookmark_snapshot_add_string(builder, item->address);
+	record->title = _favorites_bookmark_snapshot_add_string(builder, item->title);
+	record->creation_date = _favorites_bookmark_snapshot_add_string(builder, item->creation_date);
+	record->update_date = _favorites_bookmark_snapshot_add_string(builder, item->update_date);
+	return !builder->failed;
+}
+
+/* Writes the file next to path and renames it over path, so that readers
+ * see either the old or the new snapshot and keep their mapping. */
+static int _favorites_bookmark_snapshot_save(const char *path,
+		bookmark_snapshot_header_s *header, bookmark_snapshot_builder_s *builder)
+{
+	char	temp[1024];
+	FILE *fp;
+	int ok;
+
+	if (snprintf(temp, sizeof(temp), "%s.%d", path, (int)getpid()) >= (int)sizeof(temp))
+		return -1;
+	fp = fopen(temp, "wb");
+	if (fp == NULL) {
+		FAVORITES_LOGE("file opening is failed.");
+		return -1;
+	}
+	ok = fwrite(header, sizeof(*header), 1, fp) == 1
+		&& (builder->record_count == 0 || fwrite(builder->records,
+			sizeof(bookmark_snapshot_record_s), builder->record_count, fp)
+			== builder->record_count)
+		&& (builder->string_size == 0 || fwrite(builder->strings,
+			builder->string_size, 1, fp) == 1);
+	if (fclose(fp) != 0)
+		ok = 0;
+	if (!ok || rename(temp, path) != 0) {
+		FAVORITES_LOGE("writing %s is failed.", path);
+		unlink(temp);
+		return -1;
+	}
+	return 0;
+}
+
+/* Version of the snapshot at path, -1 if there is none */
+static int64_t _favorites_bookmark_snapshot_file_version(const char *path)
+{
+	bookmark_snapshot_header_s header;
+	FILE *fp = fopen(path, "rb");
+	int64_t version = -1;
+
+	if (fp == NULL)
+		return -1;
+	if (fread(&header, sizeof(header), 1, fp) == 1
+			&& !memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC))
+			&& header.format == SNAPSHOT_FORMAT
+			&& header.byte_order == SNAPSHOT_BYTE_ORDER)
+		version = header.version;
+	fclose(fp);
+	return version;
+}
+
+static int _favorites_bookmark_snapshot_generate(const char *path, int force)
+{
+	bookmark_snapshot_header_s header;
+	bookmark_snapshot_builder_s builder;
+	sqlite3_int64 version;
+	int ret;
+
+	if (_favorites_open_bookmark_db() < 0) {
+		FAVORITES_LOGE("db_util_open is failed\n");
+		return FAVORITES_ERROR_DB_FAILED;
+	}
+	/* read before the rows, a concurrent change only makes the snapshot
+	 * look older than it is */
+	ret = _favorites_bookmark_get_meta("bookmarks_version", &version);
+	_favorites_close_bookmark_db();
+	if (ret < 0)
+		return FAVORITES_ERROR_DB_FAILED;
+	if (!force && _favorites_bookmark_snapshot_file_version(path) == version)
+		return FAVORITES_ERROR_NONE;
+
+	memset(&builder, 0x00, sizeof(builder));
+	ret = favorites_bookmark_foreach_tree(_favorites_bookmark_snapshot_add, &builder);
+	if (ret == FAVORITES_ERROR_NONE && builder.failed)
+		ret = FAVORITES_ERROR_DB_FAILED;
+
+	if (ret == FAVORITES_ERROR_NONE) {
+		memset(&header, 0x00, sizeof(header));
+		memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+		header.format = SNAPSHOT_FORMAT;
+		header.byte_order = SNAPSHOT_BYTE_ORDER;
+		header.version = version;
+		header.record_count = builder.record_count;
+		header.record_size = sizeof(bookmark_snapshot_record_s);
+		header.string_size = builder.string_size;
+		if (_favorites_bookmark_snapshot_save(path, &header, &builder) < 0)
+			ret = FAVORITES_ERROR_INVALID_PARAMETER;
+	}
+	free(builder.records);
+	free(builder.strings);
+	return ret;
+}
+
+/* Called after every bookmark write made through this library */
+void _favorites_bookmark_snapshot_refresh(void)
+{
+	pthread_mutex_lock(&gl_bookmark_snapshot_lock);
+	if (gl_bookmark_snapshot_path != NULL
+			&& _favorites_bookmark_snapshot_generate(gl_bookmark_snapshot_path, 1)
+			!= FAVORITES_ERROR_NONE)
+		FAVORITES_LOGE("bookmark snapshot is not updated\n");
+	pthread_mutex_unlock(&gl_bookmark_snapshot_lock);
+}
+
+static const char *_favorites_bookmark_snapshot_string(
+		favorites_bookmark_snapshot_h snapshot, uint32_t offset)
+{
+	if (offset >= snapshot->string_size)
+		return NULL;
+	return snapshot->strings + offset;
+}
+
+/*************************************************************
+ *	APIs for Internet favorites
+ *************************************************************/
+int favorites_bookmark_snapshot_write(const char *path)
+{
+	FAVORITES_API_ENTER();
+	int ret;
+
+	FAVORITES_NULL_ARG_CHECK(path);
+	pthread_mutex_lock(&gl_bookmark_snapshot_lock);
+	ret = _favorites_bookmark_snapshot_generate(path, 0);
+	pthread_mutex_unlock(&gl_bookmark_snapshot_lock);
+	return ret;
+}
+
+int favorites_bookmark_set_snapshot_path(const char *path)
+{
+	FAVORITES_API_ENTER();
+	char *copy = NULL;
+	int ret = FAVORITES_ERROR_NONE;
+
+	if (path != NULL) {
+		copy = strdup(path);
+		if (copy == NULL)
+			return FAVORITES_ERROR_DB_FAILED;
+	}
+	pthread_mutex_lock(&gl_bookmark_snapshot_lock);
+	free(gl_bookmark_snapshot_path);
+	gl_bookmark_snapshot_path = copy;
+	if (copy != NULL)
+		ret = _favorites_bookmark_snapshot_generate(copy, 0);
+	pthread_mutex_unlock(&gl_bookmark_snapshot_lock);
+	return ret;
+}
+
+int favorites_bookmark_snapshot_open(const char *path, favorites_bookmark_snapshot_h *snapshot)
+{
+	FAVORITES_NULL_ARG_CHECK(path);
+	FAVORITES_NULL_ARG_CHECK(snapshot);
+	const bookmark_snapshot_header_s *header;
+	favorites_bookmark_snapshot_h handle;
+	struct stat st;
+	void *map;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		FAVORITES_LOGE("file opening is failed.");
+		return FAVORITES_ERROR_INVALID_PARAMETER;
+	}
+	if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(bookmark_snapshot_header_s)) {
+		close(fd);
+		return FAVORITES_ERROR_INVALID_PARAMETER;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		FAVORITES_LOGE("mmap is failed.");
+		return FAVORITES_ERROR_INVALID_PARAMETER;
+	}
+
+	/* the header is the only thing checked, strings are checked on use */
+	header = (const bookmark_snapshot_header_s *)map;
+	if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC))
+			|| header->format != SNAPSHOT_FORMAT
+			|| header->byte_order != SNAPSHOT_BYTE_ORDER
+			|| header->record_size != sizeof(bookmark_snapshot_record_s)
+			|| (uint64_t)st.st_size != sizeof(*header)
+				+ (uint64_t)header->record_count * sizeof(bookmark_snapshot_record_s)
+				+ header->string_size
+			|| (header->string_size > 0
+				&& ((const char *)map)[st.st_size - 1] != '\0')) {
+		FAVORITES_LOGE("%s is not a bookmark snapshot.", path);
+		munmap(map, st.st_size);
+		return FAVORITES_ERROR_INVALID_PARAMETER;
+	}
+
+	handle = (favorites_bookmark_snapshot_h)calloc(1, sizeof(struct favorites_bookmark_snapshot));
+	if (handle == NULL) {
+		munmap(map, st.st_size);
+		return FAVORITES_ERROR_DB_FAILED;
+	}
+	handle->map = map;
+	handle->size = st.st_size;
+	handle->records = (const bookmark_snapshot_record_s *)(header + 1);
+	handle->record_count = header->record_count;
+	handle->strings = (const char *)(handle->records + header->record_count);
+	handle->string_size = header->string_size;
+	*snapshot = handle;
+	return FAVORITES_ERROR_NONE;
+}
+
+int favorites_bookmark_snapshot_foreach(favorites_bookmark_snapshot_h snapshot,
+		favorites_bookmark_tree_cb callback, void *user_data)
+{
+	FAVORITES_NULL_ARG_CHECK(snapshot);
+	FAVORITES_NULL_ARG_CHECK(callback);
+	uint32_t i;
+
+	for (i = 0; i < snapshot->record_count; i++) {
+		const bookmark_snapshot_record_s *record = &snapshot->records[i];
+		favorites_bookmark_entry_s result;
+
+		/* the strings point into the read-only mapping */
+		memset(&result, 0x00, sizeof(favorites_bookmark_entry_s));
+		result.id = record->id;
+		result.is_folder = record->is_folder;
+		result.folder_id = record->folder_id;
+		result.order_index = record->order_index;
+		result.editable = record->editable;
+		result.address = (char *)_favorites_bookmark_snapshot_string(snapshot, record->address);
+		result.title = (char *)_favorites_bookmark_snapshot_string(snapshot, record->title);
+		result.creation_date = (char *)_favorites_bookmark_snapshot_string(snapshot,
+				record->creation_date);
+		result.update_date = (char *)_favorites_bookmark_snapshot_string(snapshot,
+				record->update_date);
+		if (!callback(&result, record->depth, user_data))
+			break;
+	}
+	return FAVORITES_ERROR_NONE;
+}
+
+int favorites_bookmark_snapshot_close(favorites_bookmark_snapshot_h snapshot)
+{
+	FAVORITES_NULL_ARG_CHECK(snapshot);
+
+	munmap(snapshot->map, snapshot->size);
+	free(snapshot);
+	return FAVORITES_ERROR_NONE;
+}
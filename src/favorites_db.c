@@ -0,0 +1,463 @@
+/*
+ * Copyright (c) 2011 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include <dlog.h>
+#include <db-util.h>
+#include <favorites.h>
+#include <favorites_private.h>
+
+/* Helpers shared by the bookmark and history databases */
+
+/* set by favorites_db_set_read_only(), for the connections opened next */
+static int gl_favorites_db_read_only = 0;
+
+int _favorites_db_is_read_only(void)
+{
+	return gl_favorites_db_read_only;
+}
+
+/* Opens a connection, in read-only mode without the db-util hooks nor a
+ * shared cache. Returns an sqlite result code like db_util_open(). */
+int _favorites_db_open(const char *path, sqlite3 **db)
+{
+	int nError;
+
+	if (!gl_favorites_db_read_only)
+		return db_util_open(path, db, DB_UTIL_REGISTER_HOOK_METHOD);
+
+	nError = sqlite3_open_v2(path, db,
+			SQLITE_OPEN_READONLY | SQLITE_OPEN_PRIVATECACHE, NULL);
+	if (nError != SQLITE_OK)
+		return nError;
+	/* refuses writes even where the file would allow them, e.g. temp tables */
+	if (_favorites_db_exec(*db, "pragma query_only=1") < 0)
+		return SQLITE_ERROR;
+	return SQLITE_OK;
+}
+
+int _favorites_db_exec(sqlite3 *db, const char *sql)
+{
+	char *errmsg = NULL;
+
+	if (sqlite3_exec(db, sql, NULL, NULL, &errmsg) != SQLITE_OK) {
+		FAVORITES_LOGE("sqlite3_exec is failed(%s): %s", errmsg, sql);
+		sqlite3_free(errmsg);
+		return -1;
+	}
+	return 0;
+}
+
+int _favorites_db_column_exists(sqlite3 *db, const char *table, const char *column)
+{
+	int nError;
+	int found = 0;
+	sqlite3_stmt *stmt;
+	char	query[1024];
+
+	snprintf(query, sizeof(query), "pragma table_info(%s)", table);
+	nError = sqlite3_prepare_v2(db, query, -1, &stmt, NULL);
+	if (nError != SQLITE_OK) {
+		FAVORITES_LOGE("sqlite3_prepare_v2 is failed.\n");
+		sqlite3_finalize(stmt);
+		return -1;
+	}
+	while (!found && (nError = sqlite3_step(stmt)) == SQLITE_ROW) {
+		const char *name = (const char *)sqlite3_column_text(stmt, 1);
+		if (name && !strcmp(name, column))
+			found = 1;
+	}
+	sqlite3_finalize(stmt);
+	return found;
+}
+
+/* ALTER TABLE is not idempotent, so columns are only added when missing */
+int _favorites_db_add_column(sqlite3 *db, const char *table,
+		const char *column, const char *decl)
+{
+	char	query[1024];
+	int exists = _favorites_db_column_exists(db, table, column);
+
+	if (exists < 0)
+		return -1;
+	if (exists)
+		return 0;
+	snprintf(query, sizeof(query), "alter table %s add column %s %s",
+			table, column, decl);
+	return _favorites_db_exec(db, query);
+}
+
+/* schema_version recorded in favorites_meta, 0 while there is none */
+static int _favorites_db_get_schema_version(sqlite3 *db)
+{
+	sqlite3_stmt *stmt;
+	int version = 0;
+
+	/* favorites_meta itself is created by the first upgrade */
+	if (sqlite3_prepare_v2(db,
+			"select value from favorites_meta where name='schema_version'",
+			-1, &stmt, NULL) != SQLITE_OK) {
+		sqlite3_finalize(stmt);
+		return 0;
+	}
+	if (sqlite3_step(stmt) == SQLITE_ROW)
+		version = sqlite3_column_int(stmt, 0);
+	sqlite3_finalize(stmt);
+	return version;
+}
+
+/* Brings a db to the given schema version in a single transaction. The
+ * missing columns are added first so that the statements may refer to
+ * them, then the schema is applied and the version recorded; a db already
+ * at the version skips both. The backfill statements run in any case. */
+int _favorites_db_upgrade(sqlite3 *db, const favorites_db_column_s *columns,
+		const char **schema, int version, const char **backfill)
+{
+	char	query[128];
+	int i;
+	int ret = 0;
+
+	if (_favorites_db_exec(db, "begin immediate") < 0)
+		return -1;
+	if (_favorites_db_get_schema_version(db) < version) {
+		FAVORITES_LOGD("upgrading %s to schema version %d\n",
+				sqlite3_db_filename(db, "main"), version);
+		for (i = 0; ret == 0 && columns != NULL && columns[i].table != NULL; i++) {
+			ret = _favorites_db_add_column(db, columns[i].table,
+					columns[i].column, columns[i].decl);
+		}
+		for (i = 0; ret == 0 && schema != NULL && schema[i] != NULL; i++)
+			ret = _favorites_db_exec(db, schema[i]);
+		if (ret == 0) {
+			snprintf(query, sizeof(query), "insert or replace into favorites_meta\
+					values('schema_version', %d)", version);
+			ret = _favorites_db_exec(db, query);
+		}
+	}
+	for (i = 0; ret == 0 && backfill != NULL && backfill[i] != NULL; i++)
+		ret = _favorites_db_exec(db, backfill[i]);
+	if (ret == 0)
+		ret = _favorites_db_exec(db, "commit");
+	if (ret < 0)
+		sqlite3_exec(db, "rollback", NULL, NULL, NULL);
+	return ret;
+}
+
+/*
+ * 64 bit FNV-1a of the normalized url. Scheme and host are case folded,
+ * the fragment and a trailing '/' are ignored. Urls differing only in
+ * those share a hash, callers compare the address itself afterwards.
+ */
+sqlite3_int64 _favorites_db_url_hash(const char *url)
+{
+	unsigned long long hash = 14695981039346656037ULL;
+	const char *p = url;
+	const char *end;
+	const char *host_end = NULL;
+	const char *scheme = strstr(url, "://");
+
+	end = strchr(url, '#');
+	if (end == NULL)
+		end = url + strlen(url);
+	if (end > url && end[-1] == '/')
+		end--;
+
+	if (scheme != NULL) {
+		host_end = strchr(scheme + 3, '/');
+		if (host_end == NULL || host_end > end)
+			host_end = end;
+	}
+	for (; p < end; p++) {
+		unsigned char c = (unsigned char)*p;
+		if (p < host_end && c >= 'A' && c <= 'Z')
+			c += 'a' - 'A';
+		hash ^= c;
+		hash *= 1099511628211ULL;
+	}
+	return (sqlite3_int64)hash;
+}
+
+/* favorites_url_hash(address), NULL for a NULL address */
+static void _favorites_db_url_hash_func(sqlite3_context *context,
+		int argc, sqlite3_value **argv)
+{
+	const char *url = (const char *)sqlite3_value_text(argv[0]);
+
+	if (url == NULL) {
+		sqlite3_result_null(context);
+		return;
+	}
+	sqlite3_result_int64(context, _favorites_db_url_hash(url));
+}
+
+/*
+ * SQL functions used by the schema upgrades. They only exist on our own
+ * connections, so triggers must not call them: the browser writes the same
+ * tables without them.
+ */
+int _favorites_db_register_functions(sqlite3 *db)
+{
+	if (sqlite3_create_function(db, "favorites_url_hash", 1, SQLITE_UTF8,
+			NULL, _favorites_db_url_hash_func, NULL, NULL) != SQLITE_OK) {
+		FAVORITES_LOGE("sqlite3_create_function is failed.\n");
+		return -1;
+	}
+	return 0;
+}
+
+extern __thread sqlite3 *gl_internet_bookmark_db;
+extern __thread sqlite3 *gl_internet_history_db;
+
+/* Single integer value of a pragma or query on the given db, -1 on failure */
+static int _favorites_db_get_pragma(sqlite3 *db, const char *query)
+{
+	sqlite3_stmt *stmt;
+	int value = -1;
+
+	if (sqlite3_prepare_v2(db, query, -1, &stmt, NULL) != SQLITE_OK) {
+		FAVORITES_LOGE("sqlite3_prepare_v2 is failed.\n");
+		sqlite3_finalize(stmt);
+		return -1;
+	}
+	if (sqlite3_step(stmt) == SQLITE_ROW)
+		value = sqlite3_column_int(stmt, 0);
+	sqlite3_finalize(stmt);
+	return value;
+}
+
+static int _favorites_db_enable_incremental_vacuum(sqlite3 *db)
+{
+	/* 2: INCREMENTAL */
+	if (_favorites_db_get_pragma(db, "pragma auto_vacuum") == 2)
+		return 0;
+	/* the mode of an existing db only changes with a full rebuild */
+	if (_favorites_db_exec(db, "pragma auto_vacuum=incremental") < 0
+			|| _favorites_db_exec(db, "vacuum") < 0)
+		return -1;
+	return 0;
+}
+
+/* Moves up to budget free pages back to the file system, returns the
+ * number of pages freed or -1 */
+static int _favorites_db_incremental_vacuum(sqlite3 *db, int budget)
+{
+	char	query[64];
+	int before;
+	int after;
+
+	if (_favorites_db_get_pragma(db, "pragma auto_vacuum") != 2)
+		return 0;
+	before = _favorites_db_get_pragma(db, "pragma freelist_count");
+	if (before <= 0)
+		return before < 0 ? -1 : 0;
+
+	snprintf(query, sizeof(query), "pragma incremental_vacuum(%d)",
+			budget < before ? budget : before);
+	if (_favorites_db_exec(db, query) < 0)
+		return -1;
+	after = _favorites_db_get_pragma(db, "pragma freelist_count");
+	if (after < 0)
+		return -1;
+	return before - after;
+}
+
+/*
+ * Invariants of each db, as queries returning the number of rows which
+ * break them. They cover what the triggers maintain, so that concurrent
+ * writers can be checked against each other.
+ */
+struct db_check {
+	const char *name;
+	const char *query;
+};
+typedef struct db_check db_check_s;
+
+static const db_check_s gl_bookmark_db_checks[] = {
+	{ "bookmarks_count", "select (select value from favorites_meta\
+		where name='bookmarks_count') is not (select count(*) from bookmarks\
+		where parent != 0)" },
+	{ "folders_count", "select (select value from favorites_meta\
+		where name='folders_count') is not (select count(*) from bookmarks\
+		where type=1 and parent != 0)" },
+	{ "folder counts", "select count(*) from (select parent, sum(type=0) as b,\
+		sum(type=1) as f from bookmarks group by parent) c\
+		left join favorites_folder_counts fc on fc.folder_id=c.parent\
+		where fc.bookmarks is not c.b or fc.folders is not c.f" },
+	{ "stale folder counts", "select count(*) from favorites_folder_counts fc\
+		where (bookmarks != 0 or folders != 0)\
+		and not exists (select 1 from bookmarks where parent=fc.folder_id)" },
+	{ "orphan items", "select count(*) from bookmarks b where parent != 0\
+		and not exists (select 1 from bookmarks f where f.id=b.parent and f.type=1)" },
+	{ "url hashes", "select count(*) from bookmarks where url_hash is not null\
+		and url_hash != favorites_url_hash(address)" },
+	{ NULL, NULL }
+};
+
+static const db_check_s gl_history_db_checks[] = {
+	{ "history_count", "select (select value from favorites_meta\
+		where name='history_count') is not (select count(*) from history)" },
+	{ "host aggregates", "select count(*) from (select host, sum(coalesce(counter, 0)) as v,\
+		count(*) as p, max(visitdate) as l from history where host is not null\
+		group by host) c left join favorites_history_hosts h on h.host=c.host\
+		where h.visits is not c.v or h.pages is not c.p or h.last_visit is not c.l" },
+	{ "stale host aggregates", "select count(*) from favorites_history_hosts h\
+		where not exists (select 1 from history where host=h.host)" },
+	{ "url hashes", "select count(*) from history where url_hash is not null\
+		and url_hash != favorites_url_hash(address)" },
+	{ NULL, NULL }
+};
+
+/* Runs quick_check and the checks on one snapshot of the db, returns the
+ * number of violations found or -1 */
+static int _favorites_db_check(sqlite3 *db, const db_check_s *checks)
+{
+	sqlite3_stmt *stmt;
+	int violations = 0;
+	int count;
+	int i;
+
+	if (_favorites_db_exec(db, "begin") < 0)
+		return -1;
+	if (sqlite3_prepare_v2(db, "pragma quick_check", -1, &stmt, NULL) != SQLITE_OK) {
+		FAVORITES_LOGE("sqlite3_prepare_v2 is failed.\n");
+		sqlite3_finalize(stmt);
+		sqlite3_exec(db, "rollback", NULL, NULL, NULL);
+		return -1;
+	}
+	while (sqlite3_step(stmt) == SQLITE_ROW) {
+		const char *result = (const char *)sqlite3_column_text(stmt, 0);
+		if (result != NULL && strcmp(result, "ok")) {
+			FAVORITES_LOGE("quick_check: %s\n", result);
+			violations++;
+		}
+	}
+	sqlite3_finalize(stmt);
+
+	for (i = 0; checks[i].name != NULL; i++) {
+		count = _favorites_db_get_pragma(db, checks[i].query);
+		if (count < 0) {
+			sqlite3_exec(db, "rollback", NULL, NULL, NULL);
+			return -1;
+		}
+		if (count > 0)
+			FAVORITES_LOGE("%s: %d violations\n", checks[i].name, count);
+		violations += count;
+	}
+	sqlite3_exec(db, "rollback", NULL, NULL, NULL);
+	return violations;
+}
+
+/*************************************************************
+ *	APIs for Internet favorites
+ *************************************************************/
+int favorites_db_set_read_only(bool read_only)
+{
+	gl_favorites_db_read_only = read_only ? 1 : 0;
+	return FAVORITES_ERROR_NONE;
+}
+
+int favorites_db_enable_incremental_vacuum(void)
+{
+	FAVORITES_API_ENTER();
+	FAVORITES_WRITABLE_CHECK();
+	int ret = FAVORITES_ERROR_NONE;
+
+	if (_favorites_open_bookmark_db() < 0) {
+		FAVORITES_LOGE("db_util_open is failed\n");
+		return FAVORITES_ERROR_DB_FAILED;
+	}
+	if (_favorites_db_enable_incremental_vacuum(gl_internet_bookmark_db) < 0)
+		ret = FAVORITES_ERROR_DB_FAILED;
+	_favorites_close_bookmark_db();
+	if (ret != FAVORITES_ERROR_NONE)
+		return ret;
+
+	if (_favorites_history_db_open() < 0) {
+		FAVORITES_LOGE("db_util_open is failed\n");
+		return FAVORITES_ERROR_DB_FAILED;
+	}
+	if (_favorites_db_enable_incremental_vacuum(gl_internet_history_db) < 0)
+		ret = FAVORITES_ERROR_DB_FAILED;
+	_favorites_history_db_close();
+	return ret;
+}
+
+int favorites_db_compact(int budget_pages, int *freed_pages)
+{
+	FAVORITES_API_ENTER();
+	FAVORITES_WRITABLE_CHECK();
+	int freed = 0;
+	int pages;
+
+	FAVORITES_INVALID_ARG_CHECK(budget_pages<=0);
+
+	/* the history is where most pages are freed */
+	if (_favorites_history_db_open() < 0) {
+		FAVORITES_LOGE("db_util_open is failed\n");
+		return FAVORITES_ERROR_DB_FAILED;
+	}
+	pages = _favorites_db_incremental_vacuum(gl_internet_history_db, budget_pages);
+	_favorites_history_db_close();
+	if (pages < 0)
+		return FAVORITES_ERROR_DB_FAILED;
+	freed += pages;
+
+	if (freed < budget_pages) {
+		if (_favorites_open_bookmark_db() < 0) {
+			FAVORITES_LOGE("db_util_open is failed\n");
+			return FAVORITES_ERROR_DB_FAILED;
+		}
+		pages = _favorites_db_incremental_vacuum(gl_internet_bookmark_db,
+				budget_pages - freed);
+		_favorites_close_bookmark_db();
+		if (pages < 0)
+			return FAVORITES_ERROR_DB_FAILED;
+		freed += pages;
+	}
+
+	if (freed_pages != NULL)
+		*freed_pages = freed;
+	return FAVORITES_ERROR_NONE;
+}
+
+int favorites_db_check_integrity(int *violations)
+{
+	FAVORITES_API_ENTER();
+	FAVORITES_NULL_ARG_CHECK(violations);
+	int bookmark_violations;
+	int history_violations;
+
+	if (_favorites_open_bookmark_db() < 0) {
+		FAVORITES_LOGE("db_util_open is failed\n");
+		return FAVORITES_ERROR_DB_FAILED;
+	}
+	bookmark_violations = _favorites_db_check(gl_internet_bookmark_db, gl_bookmark_db_checks);
+	_favorites_close_bookmark_db();
+	if (bookmark_violations < 0)
+		return FAVORITES_ERROR_DB_FAILED;
+
+	if (_favorites_history_db_open() < 0) {
+		FAVORITES_LOGE("db_util_open is failed\n");
+		return FAVORITES_ERROR_DB_FAILED;
+	}
+	history_violations = _favorites_db_check(gl_internet_history_db, gl_history_db_checks);
+	_favorites_history_db_close();
+	if (history_violations < 0)
+		return FAVORITES_ERROR_DB_FAILED;
+
+	*violations = bookmark_violations + history_violations;
+	return FAVORITES_ERROR_NONE;
+}
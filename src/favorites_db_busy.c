@@ -0,0 +1,200 @@
+/*
+ * Copyright (c) 2011 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include <dlog.h>
+#include <db-util.h>
+#include <favorites.h>
+#include <favorites_private.h>
+
+/*
+ * Busy handler of every connection. While another connection holds the
+ * lock, sqlite calls it before each retry: it sleeps for an exponential
+ * backoff with jitter, and gives up once the policy timeout or number of
+ * attempts is reached, the caller then getting SQLITE_BUSY. The waits are
+ * accounted to the function which opened the connection.
+ */
+#define BUSY_DEFAULT_TIMEOUT_MS		1000
+#define BUSY_DEFAULT_INITIAL_BACKOFF_MS	1
+#define BUSY_DEFAULT_MAX_BACKOFF_MS	64
+#define BUSY_DEFAULT_MAX_ATTEMPTS	32
+#define BUSY_STATS_MAX			128
+
+struct busy_stats {
+	const char *api;
+	int busy_count;
+	int retry_count;
+	int failure_count;
+	long long wait_ms;
+	int max_wait_ms;
+};
+typedef struct busy_stats busy_stats_s;
+
+static pthread_mutex_t gl_busy_lock = PTHREAD_MUTEX_INITIALIZER;
+static int gl_busy_timeout_ms = BUSY_DEFAULT_TIMEOUT_MS;
+static int gl_busy_initial_backoff_ms = BUSY_DEFAULT_INITIAL_BACKOFF_MS;
+static int gl_busy_max_backoff_ms = BUSY_DEFAULT_MAX_BACKOFF_MS;
+static int gl_busy_max_attempts = BUSY_DEFAULT_MAX_ATTEMPTS;
+static busy_stats_s gl_busy_stats[BUSY_STATS_MAX];
+static int gl_busy_stats_count = 0;
+
+/* wait of the current busy episode of this thread */
+static __thread int gl_busy_episode_wait_ms = 0;
+static __thread unsigned int gl_busy_seed = 0;
+
+/* public function the thread is in, see FAVORITES_API_ENTER() */
+__thread const char *gl_favorites_api = NULL;
+
+void _favorites_api_leave(const char **saved)
+{
+	gl_favorites_api = *saved;
+}
+
+/* Stats of api, called with gl_busy_lock held. The apis are __FUNCTION__
+ * strings, the last slot collects the overflow. */
+static busy_stats_s *_favorites_db_busy_stats(const char *api)
+{
+	int i;
+
+	for (i = 0; i < gl_busy_stats_count; i++) {
+		if (gl_busy_stats[i].api == api || !strcmp(gl_busy_stats[i].api, api))
+			return &gl_busy_stats[i];
+	}
+	if (gl_busy_stats_count == BUSY_STATS_MAX)
+		return &gl_busy_stats[BUSY_STATS_MAX - 1];
+	memset(&gl_busy_stats[i], 0x00, sizeof(busy_stats_s));
+	gl_busy_stats[i].api = gl_busy_stats_count == BUSY_STATS_MAX - 1 ? "other" : api;
+	gl_busy_stats_count++;
+	return &gl_busy_stats[i];
+}
+
+static int _favorites_db_busy_handler(void *data, int count)
+{
+	const char *api = (const char *)data;
+	busy_stats_s *stats;
+	int backoff;
+	int remaining;
+
+	if (count == 0) {
+		gl_busy_episode_wait_ms = 0;
+		if (gl_busy_seed == 0)
+			gl_busy_seed = (unsigned int)time(NULL) ^ (unsigned int)(unsigned long)&gl_busy_seed;
+	}
+
+	pthread_mutex_lock(&gl_busy_lock);
+	stats = _favorites_db_busy_stats(api);
+	if (count == 0)
+		stats->busy_count++;
+	remaining = gl_busy_timeout_ms - gl_busy_episode_wait_ms;
+	if (remaining <= 0 || (gl_busy_max_attempts > 0 && count >= gl_busy_max_attempts)) {
+		stats->failure_count++;
+		pthread_mutex_unlock(&gl_busy_lock);
+		FAVORITES_LOGE("%s: database is locked, given up after %d ms\n",
+				api, gl_busy_episode_wait_ms);
+		return 0;
+	}
+	/* half of the backoff is random, so that the waiters do not retry together */
+	backoff = gl_busy_initial_backoff_ms << (count < 16 ? count : 16);
+	if (backoff > gl_busy_max_backoff_ms || backoff <= 0)
+		backoff = gl_busy_max_backoff_ms;
+	backoff = backoff / 2 + rand_r(&gl_busy_seed) % (backoff - backoff / 2 + 1);
+	if (backoff > remaining)
+		backoff = remaining;
+	if (backoff < 1)
+		backoff = 1;
+	stats->retry_count++;
+	stats->wait_ms += backoff;
+	if (gl_busy_episode_wait_ms + backoff > stats->max_wait_ms)
+		stats->max_wait_ms = gl_busy_episode_wait_ms + backoff;
+	pthread_mutex_unlock(&gl_busy_lock);
+
+	sqlite3_sleep(backoff);
+	gl_busy_episode_wait_ms += backoff;
+	return 1;
+}
+
+/* Installs the busy handler on a connection opened on behalf of api,
+ * which must be a string literal or __FUNCTION__. */
+void _favorites_db_set_busy_handler(sqlite3 *db, const char *api)
+{
+	if (sqlite3_busy_handler(db, _favorites_db_busy_handler, (void *)api) != SQLITE_OK)
+		FAVORITES_LOGE("sqlite3_busy_handler is failed\n");
+}
+
+/*************************************************************
+ *	APIs for Internet favorites
+ *************************************************************/
+int favorites_db_set_busy_policy(int timeout_ms, int initial_backoff_ms,
+		int max_backoff_ms, int max_attempts)
+{
+	FAVORITES_INVALID_ARG_CHECK(timeout_ms<0);
+	FAVORITES_INVALID_ARG_CHECK(initial_backoff_ms<=0);
+	FAVORITES_INVALID_ARG_CHECK(max_backoff_ms<initial_backoff_ms);
+	FAVORITES_INVALID_ARG_CHECK(max_attempts<0);
+
+	pthread_mutex_lock(&gl_busy_lock);
+	gl_busy_timeout_ms = timeout_ms;
+	gl_busy_initial_backoff_ms = initial_backoff_ms;
+	gl_busy_max_backoff_ms = max_backoff_ms;
+	gl_busy_max_attempts = max_attempts;
+	pthread_mutex_unlock(&gl_busy_lock);
+	return FAVORITES_ERROR_NONE;
+}
+
+int favorites_db_foreach_lock_stats(favorites_db_lock_stats_cb callback, void *user_data)
+{
+	FAVORITES_NULL_ARG_CHECK(callback);
+	busy_stats_s *copy;
+	int count;
+	int i;
+
+	/* the callback runs unlocked, on a copy */
+	pthread_mutex_lock(&gl_busy_lock);
+	count = gl_busy_stats_count;
+	copy = (busy_stats_s *)malloc((count > 0 ? count : 1) * sizeof(busy_stats_s));
+	if (copy != NULL)
+		memcpy(copy, gl_busy_stats, count * sizeof(busy_stats_s));
+	pthread_mutex_unlock(&gl_busy_lock);
+	if (copy == NULL) {
+		FAVORITES_LOGE("out of memory\n");
+		return FAVORITES_ERROR_DB_FAILED;
+	}
+
+	for (i = 0; i < count; i++) {
+		favorites_db_lock_stats_s stats;
+		stats.api = copy[i].api;
+		stats.busy_count = copy[i].busy_count;
+		stats.retry_count = copy[i].retry_count;
+		stats.failure_count = copy[i].failure_count;
+		stats.wait_ms = copy[i].wait_ms;
+		stats.max_wait_ms = copy[i].max_wait_ms;
+		if (!callback(&stats, user_data))
+			break;
+	}
+	free(copy);
+	return FAVORITES_ERROR_NONE;
+}
+
+int favorites_db_reset_lock_stats(void)
+{
+	pthread_mutex_lock(&gl_busy_lock);
+	gl_busy_stats_count = 0;
+	pthread_mutex_unlock(&gl_busy_lock);
+	return FAVORITES_ERROR_NONE;
+}
@@ -0,0 +1,316 @@
+/*
+ * Copyright (c) 2011 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <dlog.h>
+#include <db-util.h>
+#include <favorites.h>
+#include <favorites_private.h>
+
+#define FAVICON_CACHE_BUCKETS		256
+#define FAVICON_CACHE_DEFAULT_SIZE	(2 * 1024 * 1024)
+/* accounted size of an entry without pixels (negative cache entry) */
+#define FAVICON_CACHE_ENTRY_COST	64
+
+/*
+ * Byte-budgeted LRU of decoded ARGB favicons keyed by bookmark id and
+ * variant size (0 for the original image).
+ * Entries are reference counted: the cache holds one reference and every
+ * Evas image object sharing the pixel buffer holds another, so an evicted
+ * entry stays alive until the last icon using it is deleted.
+ */
+struct favicon_cache_entry {
+	favicon_entry_s favicon;	/* must be the first member */
+	int id;
+	int size;
+	int refcount;
+	struct favicon_cache_entry *hash_next;
+	struct favicon_cache_entry *lru_prev;
+	struct favicon_cache_entry *lru_next;
+};
+typedef struct favicon_cache_entry favicon_cache_entry_s;
+
+/* identifies the state of the db files without asking SQLite */
+struct favicon_cache_stamp {
+	struct timespec db_mtime;
+	off_t db_size;
+	struct timespec wal_mtime;
+	off_t wal_size;
+};
+
+static pthread_mutex_t gl_favicon_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static favicon_cache_entry_s *gl_favicon_cache_table[FAVICON_CACHE_BUCKETS];
+static favicon_cache_entry_s *gl_favicon_cache_lru_head = NULL;	/* most recent */
+static favicon_cache_entry_s *gl_favicon_cache_lru_tail = NULL;	/* least recent */
+static int gl_favicon_cache_bytes = 0;
+static int gl_favicon_cache_budget = FAVICON_CACHE_DEFAULT_SIZE;
+static struct favicon_cache_stamp gl_favicon_cache_stamp;
+
+static void _favorites_favicon_cache_get_stamp(struct favicon_cache_stamp *stamp)
+{
+	struct stat st;
+	char wal_name[1024];
+
+	memset(stamp, 0x00, sizeof(struct favicon_cache_stamp));
+	if (stat(_favorites_get_bookmark_db_name(), &st) == 0) {
+		stamp->db_mtime = st.st_mtim;
+		stamp->db_size = st.st_size;
+	}
+	snprintf(wal_name, sizeof(wal_name), "%s-wal", _favorites_get_bookmark_db_name());
+	if (stat(wal_name, &st) == 0) {
+		stamp->wal_mtime = st.st_mtim;
+		stamp->wal_size = st.st_size;
+	}
+}
+
+static int _favorites_favicon_cache_stamp_equal(const struct favicon_cache_stamp *a,
+		const struct favicon_cache_stamp *b)
+{
+	return a->db_mtime.tv_sec == b->db_mtime.tv_sec
+		&& a->db_mtime.tv_nsec == b->db_mtime.tv_nsec
+		&& a->db_size == b->db_size
+		&& a->wal_mtime.tv_sec == b->wal_mtime.tv_sec
+		&& a->wal_mtime.tv_nsec == b->wal_mtime.tv_nsec
+		&& a->wal_size == b->wal_size;
+}
+
+static int _favorites_favicon_cache_cost(favicon_cache_entry_s *entry)
+{
+	return entry->favicon.length + FAVICON_CACHE_ENTRY_COST;
+}
+
+static void _favorites_favicon_cache_unref(favicon_cache_entry_s *entry)
+{
+	if (--entry->refcount > 0)
+		return;
+	_FAVORITES_FREE(entry->favicon.data);
+	free(entry);
+}
+
+static void _favorites_favicon_cache_unlink(favicon_cache_entry_s *entry)
+{
+	favicon_cache_entry_s **slot =
+		&gl_favicon_cache_table[entry->id % FAVICON_CACHE_BUCKETS];
+
+	while (*slot != NULL && *slot != entry)
+		slot = &(*slot)->hash_next;
+	if (*slot != NULL)
+		*slot = entry->hash_next;
+
+	if (entry->lru_prev != NULL)
+		entry->lru_prev->lru_next = entry->lru_next;
+	else
+		gl_favicon_cache_lru_head = entry->lru_next;
+	if (entry->lru_next != NULL)
+		entry->lru_next->lru_prev = entry->lru_prev;
+	else
+		gl_favicon_cache_lru_tail = entry->lru_prev;
+
+	entry->hash_next = entry->lru_prev = entry->lru_next = NULL;
+	gl_favicon_cache_bytes -= _favorites_favicon_cache_cost(entry);
+	_favorites_favicon_cache_unref(entry);
+}
+
+static void _favorites_favicon_cache_flush(void)
+{
+	while (gl_favicon_cache_lru_head != NULL)
+		_favorites_favicon_cache_unlink(gl_favicon_cache_lru_head);
+}
+
+static void _favorites_favicon_cache_evict(void)
+{
+	while (gl_favicon_cache_bytes > gl_favicon_cache_budget
+			&& gl_favicon_cache_lru_tail != NULL)
+		_favorites_favicon_cache_unlink(gl_favicon_cache_lru_tail);
+}
+
+/* Returns a referenced entry for the bookmark, or NULL on a miss */
+favicon_entry_h _favorites_favicon_cache_lookup(int id, int size)
+{
+	favicon_cache_entry_s *entry;
+	struct favicon_cache_stamp stamp;
+
+	_favorites_favicon_cache_get_stamp(&stamp);
+
+	pthread_mutex_lock(&gl_favicon_cache_lock);
+	if (!_favorites_favicon_cache_stamp_equal(&stamp, &gl_favicon_cache_stamp)) {
+		/* somebody wrote to the bookmark db since the cache was filled */
+		_favorites_favicon_cache_flush();
+		gl_favicon_cache_stamp = stamp;
+	}
+
+	entry = gl_favicon_cache_table[id % FAVICON_CACHE_BUCKETS];
+	while (entry != NULL && (entry->id != id || entry->size != size))
+		entry = entry->hash_next;
+
+	if (entry != NULL && entry != gl_favicon_cache_lru_head) {
+		/* move to the front of the LRU */
+		entry->lru_prev->lru_next = entry->lru_next;
+		if (entry->lru_next != NULL)
+			entry->lru_next->lru_prev = entry->lru_prev;
+		else
+			gl_favicon_cache_lru_tail = entry->lru_prev;
+		entry->lru_prev = NULL;
+		entry->lru_next = gl_favicon_cache_lru_head;
+		gl_favicon_cache_lru_head->lru_prev = entry;
+		gl_favicon_cache_lru_head = entry;
+	}
+	if (entry != NULL)
+		entry->refcount++;
+	pthread_mutex_unlock(&gl_favicon_cache_lock);
+
+	return (favicon_entry_h)entry;
+}
+
+/* Copies the favicon read from the db into a new entry and caches it.
+ * Returns a referenced entry. */
+favicon_entry_h _favorites_favicon_cache_insert(int id, int size,
+		const void *data, int length, int w, int h)
+{
+	void *copy = NULL;
+
+	if (data != NULL && length > 0) {
+		copy = malloc(length);
+		if (copy == NULL)
+			return NULL;
+		memcpy(copy, data, length);
+	} else {
+		length = 0;
+	}
+	return _favorites_favicon_cache_insert_buffer(id, size, copy, length, w, h);
+}
+
+/* Same as _favorites_favicon_cache_insert() but takes ownership of the
+ * malloc'ed data, which is freed on failure too. */
+favicon_entry_h _favorites_favicon_cache_insert_buffer(int id, int size,
+		void *data, int length, int w, int h)
+{
+	favicon_cache_entry_s *entry;
+
+	entry = (favicon_cache_entry_s *)calloc(1, sizeof(favicon_cache_entry_s));
+	if (entry == NULL) {
+		_FAVORITES_FREE(data);
+		return NULL;
+	}
+	entry->favicon.data = data;
+	entry->favicon.length = data != NULL ? length : 0;
+	entry->favicon.w = w;
+	entry->favicon.h = h;
+	entry->id = id;
+	entry->size = size;
+	entry->refcount = 1;
+
+	pthread_mutex_lock(&gl_favicon_cache_lock);
+	if (_favorites_favicon_cache_cost(entry) <= gl_favicon_cache_budget) {
+		favicon_cache_entry_s *old = gl_favicon_cache_table[id % FAVICON_CACHE_BUCKETS];
+
+		while (old != NULL && (old->id != id || old->size != size))
+			old = old->hash_next;
+		if (old != NULL)
+			_favorites_favicon_cache_unlink(old);
+
+		entry->hash_next = gl_favicon_cache_table[id % FAVICON_CACHE_BUCKETS];
+		gl_favicon_cache_table[id % FAVICON_CACHE_BUCKETS] = entry;
+		entry->lru_next = gl_favicon_cache_lru_head;
+		if (gl_favicon_cache_lru_head != NULL)
+			gl_favicon_cache_lru_head->lru_prev = entry;
+		gl_favicon_cache_lru_head = entry;
+		if (gl_favicon_cache_lru_tail == NULL)
+			gl_favicon_cache_lru_tail = entry;
+		entry->refcount++;
+		gl_favicon_cache_bytes += _favorites_favicon_cache_cost(entry);
+		_favorites_favicon_cache_evict();
+	}
+	pthread_mutex_unlock(&gl_favicon_cache_lock);
+
+	return (favicon_entry_h)entry;
+}
+
+void _favorites_favicon_cache_release(favicon_entry_h favicon)
+{
+	if (favicon == NULL)
+		return;
+	pthread_mutex_lock(&gl_favicon_cache_lock);
+	_favorites_favicon_cache_unref((favicon_cache_entry_s *)favicon);
+	pthread_mutex_unlock(&gl_favicon_cache_lock);
+}
+
+/* Drops the cached favicons of one bookmark, or all of them if id < 0 */
+void _favorites_favicon_cache_invalidate(int id)
+{
+	favicon_cache_entry_s *entry;
+	favicon_cache_entry_s *next;
+
+	pthread_mutex_lock(&gl_favicon_cache_lock);
+	if (id < 0) {
+		_favorites_favicon_cache_flush();
+	} else {
+		for (entry = gl_favicon_cache_table[id % FAVICON_CACHE_BUCKETS];
+				entry != NULL; entry = next) {
+			next = entry->hash_next;
+			if (entry->id == id)
+				_favorites_favicon_cache_unlink(entry);
+		}
+	}
+	pthread_mutex_unlock(&gl_favicon_cache_lock);
+}
+
+static void _favorites_favicon_cache_object_del_cb(void *data, Evas *evas,
+		Evas_Object *obj, void *event_info)
+{
+	_favorites_favicon_cache_release((favicon_entry_h)data);
+}
+
+/* Creates an image object showing the favicon. The pixel buffer is shared
+ * with the cache, not copied; the object keeps the entry alive until it is
+ * deleted. */
+Evas_Object *_favorites_favicon_cache_create_image(favicon_entry_h favicon, Evas *evas)
+{
+	Evas_Object *icon;
+
+	icon = evas_object_image_filled_add(evas);
+	if (icon == NULL)
+		return NULL;
+	evas_object_image_colorspace_set(icon, EVAS_COLORSPACE_ARGB8888);
+	evas_object_image_size_set(icon, favicon->w, favicon->h);
+	evas_object_image_fill_set(icon, 0, 0, favicon->w, favicon->h);
+	evas_object_image_filled_set(icon, EINA_TRUE);
+	evas_object_image_alpha_set(icon, EINA_TRUE);
+	evas_object_image_data_set(icon, favicon->data);
+
+	pthread_mutex_lock(&gl_favicon_cache_lock);
+	((favicon_cache_entry_s *)favicon)->refcount++;
+	pthread_mutex_unlock(&gl_favicon_cache_lock);
+	evas_object_event_callback_add(icon, EVAS_CALLBACK_DEL,
+			_favorites_favicon_cache_object_del_cb, favicon);
+	return icon;
+}
+
+/*************************************************************
+ *	APIs for Internet favorites
+ *************************************************************/
+int favorites_bookmark_set_favicon_cache_size(int bytes)
+{
+	FAVORITES_INVALID_ARG_CHECK(bytes < 0);
+
+	pthread_mutex_lock(&gl_favicon_cache_lock);
+	gl_favicon_cache_budget = bytes;
+	_favorites_favicon_cache_evict();
+	pthread_mutex_unlock(&gl_favicon_cache_lock);
+	return FAVORITES_ERROR_NONE;
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2011 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include <dlog.h>
+#include <db-util.h>
+#include <favorites.h>
+#include <favorites_private.h>
+
+/* Sums one source row into the row accumulator. Kept branch free over
+ * contiguous bytes so that the compiler vectorizes it. */
+static void _favorites_favicon_scale_accumulate(unsigned int *__restrict acc,
+		const unsigned char *__restrict row, int bytes)
+{
+	int i;
+
+	for (i = 0; i < bytes; i++)
+		acc[i] += row[i];
+}
+
+/*
+ * Box filter downscale of a 32 bit image (ARGB8888, premultiplied as Evas
+ * keeps it, so every byte can be averaged independently). Each destination
+ * pixel is the mean of the source pixels it covers. Returns -1 if the
+ * destination is larger than the source.
+ */
+int _favorites_favicon_scale(const void *src, int sw, int sh, void *dst, int dw, int dh)
+{
+	const unsigned char *s = (const unsigned char *)src;
+	unsigned char *d = (unsigned char *)dst;
+	unsigned int *acc;
+	int dx, dy, x, y, c;
+
+	if (dw <= 0 || dh <= 0 || dw > sw || dh > sh)
+		return -1;
+
+	acc = (unsigned int *)malloc(sw * 4 * sizeof(unsigned int));
+	if (acc == NULL)
+		return -1;
+
+	for (dy = 0; dy < dh; dy++) {
+		int y0 = dy * sh / dh;
+		int y1 = (dy + 1) * sh / dh;
+
+		memset(acc, 0x00, sw * 4 * sizeof(unsigned int));
+		for (y = y0; y < y1; y++)
+			_favorites_favicon_scale_accumulate(acc, s + y * sw * 4, sw * 4);
+
+		for (dx = 0; dx < dw; dx++) {
+			int x0 = dx * sw / dw;
+			int x1 = (dx + 1) * sw / dw;
+			unsigned int n = (x1 - x0) * (y1 - y0);
+
+			for (c = 0; c < 4; c++) {
+				unsigned int sum = 0;
+				for (x = x0; x < x1; x++)
+					sum += acc[x * 4 + c];
+				*d++ = (unsigned char)((sum + n / 2) / n);
+			}
+		}
+	}
+	free(acc);
+	return 0;
+}
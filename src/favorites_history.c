@@ -15,12 +15,16 @@
  */
 
 #include <string.h>
+#include <pthread.h>
 #include <dlog.h>
 #include <db-util.h>
 #include <favorites.h>
 #include <favorites_private.h>
 
 __thread sqlite3 *gl_internet_history_db = 0;
+/* the connection of this thread is traced from open to close */
+static __thread unsigned long long gl_history_db_trace_start = 0;
+static __thread const char *gl_history_db_trace_api = NULL;
 
 #define INTERNET_HISTORY_DB_NAME "/opt/dbspace/.browser-history.db"
 
@@ -29,6 +33,11 @@ void _favorites_history_db_close(void)
 {
 	if (gl_internet_history_db) {
 		/* ASSERT(currentThread() == m_openingThread); */
+		if (gl_history_db_trace_start) {
+			_favorites_trace_event(gl_history_db_trace_api, "history db",
+					gl_history_db_trace_start, sqlite3_total_changes(gl_internet_history_db));
+			gl_history_db_trace_start = 0;
+		}
 		db_util_close(gl_internet_history_db);
 		gl_internet_history_db = 0;
 	}
@@ -41,17 +50,179 @@ void _favorites_history_db_finalize(sqlite3_stmt *stmt)
 	}
 	_favorites_history_db_close();
 }
-int _favorites_history_db_open(void)
+
+/*
+ * Host of an address in plain SQL, since the browser writes the history
+ * too and its connections do not have our functions. history.host is set
+ * in two steps, which keeps the expressions small: first the authority,
+ * what follows "://" up to the first '/', '?' or '#', NULL for addresses
+ * without one such as about:blank; then the name in it, after the user
+ * info and without the port, case folded, NULL if empty.
+ */
+#define HISTORY_HOST_AUTHORITY(addr) \
+	"(case when instr(" addr ", '://') > 0 then substr(" addr ", instr(" addr ", '://') + 3,\
+		instr(replace(replace(substr(" addr ", instr(" addr ", '://') + 3) || '/',\
+		'?', '/'), '#', '/'), '/') - 1) end)"
+#define HISTORY_HOST_USERLESS(auth) \
+	"substr(" auth ", instr(" auth ", '@') + 1)"
+#define HISTORY_HOST_NAME(auth) \
+	"nullif(lower(case when substr(" HISTORY_HOST_USERLESS(auth) ", 1, 1) = '['\
+		then substr(" HISTORY_HOST_USERLESS(auth) ", 1, instr(" HISTORY_HOST_USERLESS(auth) ", ']'))\
+		else substr(" HISTORY_HOST_USERLESS(auth) ", 1,\
+		instr(" HISTORY_HOST_USERLESS(auth) " || ':', ':') - 1) end), '')"
+#define HISTORY_SET_HOST(addr, where) \
+	"update history set host=" HISTORY_HOST_AUTHORITY(addr) " where " where ";\
+	update history set host=" HISTORY_HOST_NAME("host") " where " where
+
+/* Schema additions owned by this library. They are applied, together with
+ * the one-time rebuilds they need, when the db is older than
+ * HISTORY_DB_SCHEMA_VERSION, which must be raised whenever they change.
+ * The backfill runs on the first open of every process and must only
+ * reach the rows it updates through an index. */
+#define HISTORY_DB_SCHEMA_VERSION	3
+
+static const char *gl_history_db_schema[] = {
+	/* range deletes walk history in visitdate order */
+	"create index if not exists history_visitdate_idx on history(visitdate)",
+	/* by url lookups, see the bookmarks url_hash column */
+	"create index if not exists history_url_hash_idx on history(url_hash)",
+	/* urls_version tells the url filter that addresses were added */
+	"create table if not exists favorites_meta\
+		(name text primary key, value integer not null)",
+	"insert or ignore into favorites_meta values('urls_version', 0)",
+	"create trigger if not exists favorites_urls_version_insert\
+		after insert on history when new.address is not null begin\
+		update favorites_meta set value=value+1 where name='urls_version'; end",
+	"create trigger if not exists favorites_urls_version_update\
+		after update of address on history when new.address is not old.address begin\
+		update favorites_meta set value=value+1 where name='urls_version'; end",
+	/* see urls_changed in the bookmark db */
+	"insert or ignore into favorites_meta values('urls_changed', 0)",
+	"create trigger if not exists favorites_urls_changed_update\
+		after update of address on history when new.address is not old.address begin\
+		update favorites_meta set value=value+1 where name='urls_changed'; end",
+	"create trigger if not exists favorites_history_url_hash_update\
+		after update of address on history when new.url_hash is old.url_hash begin\
+		update history set url_hash=null where id=new.id; end",
+	/* history_count answers favorites_history_get_count() without a scan,
+	 * counted here along with the creation of its triggers */
+	"insert or ignore into favorites_meta values('history_count', 0)",
+	"update favorites_meta set value=(select count(*) from history)\
+		where name='history_count'",
+	"create trigger if not exists favorites_history_count_insert\
+		after insert on history begin\
+		update favorites_meta set value=value+1 where name='history_count'; end",
+	"create trigger if not exists favorites_history_count_delete\
+		after delete on history begin\
+		update favorites_meta set value=value-1 where name='history_count'; end",
+	/* per host visits, pages and last visit for favorites_history_foreach_host().
+	 * history.host keeps the host of each row, its index gives the last
+	 * visit back when the latest row of a host is deleted. */
+	"create index if not exists history_host_idx on history(host, visitdate)",
+	"create table if not exists favorites_history_hosts\
+		(host text primary key, visits integer not null default 0,\
+		pages integer not null default 0, last_visit datetime)",
+	HISTORY_SET_HOST("address", "address is not null"),
+	"delete from favorites_history_hosts",
+	"insert into favorites_history_hosts(host, visits, pages, last_visit)\
+		select host, sum(coalesce(counter, 0)), count(*), max(visitdate)\
+		from history where host is not null group by host",
+	/* version 2 strips the user info and the port */
+	"drop trigger if exists favorites_history_hosts_insert",
+	"drop trigger if exists favorites_history_hosts_update",
+	"create trigger if not exists favorites_history_hosts_insert\
+		after insert on history begin\
+		" HISTORY_SET_HOST("new.address", "id=new.id") ";\
+		insert or ignore into favorites_history_hosts(host)\
+			select host from history where id=new.id and host is not null;\
+		update favorites_history_hosts set visits=visits+coalesce(new.counter, 0),\
+			pages=pages+1,\
+			last_visit=nullif(max(coalesce(last_visit, ''), coalesce(new.visitdate, '')), '')\
+			where host=(select host from history where id=new.id); end",
+	"create trigger if not exists favorites_history_hosts_update\
+		after update of address, counter, visitdate on history begin\
+		update favorites_history_hosts set visits=visits-coalesce(old.counter, 0),\
+			pages=pages-1 where host=old.host;\
+		" HISTORY_SET_HOST("new.address", "id=new.id and new.address is not old.address") ";\
+		insert or ignore into favorites_history_hosts(host)\
+			select host from history where id=new.id and host is not null;\
+		update favorites_history_hosts set visits=visits+coalesce(new.counter, 0),\
+			pages=pages+1 where host=(select host from history where id=new.id);\
+		update favorites_history_hosts set last_visit=(select max(visitdate)\
+			from history where history.host=favorites_history_hosts.host)\
+			where host in (old.host, (select host from history where id=new.id));\
+		delete from favorites_history_hosts where host=old.host and pages<=0; end",
+	"create trigger if not exists favorites_history_hosts_delete\
+		after delete on history begin\
+		update favorites_history_hosts set visits=visits-coalesce(old.counter, 0),\
+			pages=pages-1, last_visit=(select max(visitdate) from history\
+			where host=old.host) where host=old.host;\
+		delete from favorites_history_hosts where host=old.host and pages<=0; end",
+	NULL
+};
+static const char *gl_history_db_backfill[] = {
+	/* see gl_bookmark_db_backfill, history_url_hash_idx finds the rows */
+	"update history set url_hash=favorites_url_hash(address)\
+		where url_hash is null and address is not null",
+	NULL
+};
+static const favorites_db_column_s gl_history_db_columns[] = {
+	/* _favorites_db_url_hash() of address, NULL until computed */
+	{ "history", "url_hash", "integer" },
+	/* host of address, maintained by the favorites_history_hosts triggers */
+	{ "history", "host", "text" },
+	{ NULL, NULL, NULL }
+};
+static pthread_mutex_t gl_history_db_upgrade_lock = PTHREAD_MUTEX_INITIALIZER;
+static int gl_history_db_upgraded = 0;
+
+/* retention policy enforced by favorites_history_maintain(), 0 is unlimited */
+static pthread_mutex_t gl_history_retention_lock = PTHREAD_MUTEX_INITIALIZER;
+static int gl_history_retention_max_age = 0;
+static int gl_history_retention_max_count = 0;
+static long long gl_history_retention_max_size = 0;
+static favorites_history_retention_order_e gl_history_retention_order =
+	FAVORITES_HISTORY_RETENTION_OLDEST_FIRST;
+
+#define HISTORY_MAINTAIN_DEFAULT_BUDGET	100
+
+/* The db file was replaced, upgrade it again on the next open */
+void _favorites_history_db_schema_changed(void)
+{
+	pthread_mutex_lock(&gl_history_db_upgrade_lock);
+	gl_history_db_upgraded = 0;
+	pthread_mutex_unlock(&gl_history_db_upgrade_lock);
+}
+
+int _favorites_history_db_open_at(const char *api)
 {
 	_favorites_history_db_close();
-	if (db_util_open
-	    (INTERNET_HISTORY_DB_NAME, &gl_internet_history_db,
-	     DB_UTIL_REGISTER_HOOK_METHOD) != SQLITE_OK) {
+	gl_history_db_trace_start = FAVORITES_TRACE_ON(FAVORITES_TRACE_LEVEL_INFO)
+		? _favorites_trace_now() : 0;
+	gl_history_db_trace_api = api;
+	if (_favorites_db_open
+	    (INTERNET_HISTORY_DB_NAME, &gl_internet_history_db) != SQLITE_OK) {
 		db_util_close(gl_internet_history_db);
 		gl_internet_history_db = 0;
 		return -1;
 	}
-	return gl_internet_history_db ? 0 : -1;
+	if (!gl_internet_history_db)
+		return -1;
+	if (_favorites_db_register_functions(gl_internet_history_db) < 0)
+		return -1;
+	_favorites_db_set_busy_handler(gl_internet_history_db, api);
+
+	pthread_mutex_lock(&gl_history_db_upgrade_lock);
+	if (!gl_history_db_upgraded && !_favorites_db_is_read_only()) {
+		/* A failed upgrade is retried on the next open; until then only
+		 * the features relying on it are unavailable. */
+		if (_favorites_db_upgrade(gl_internet_history_db,
+				gl_history_db_columns, gl_history_db_schema,
+				HISTORY_DB_SCHEMA_VERSION, gl_history_db_backfill) == 0)
+			gl_history_db_upgraded = 1;
+	}
+	pthread_mutex_unlock(&gl_history_db_upgrade_lock);
+	return 0;
 }
 
 int _favorites_free_history_entry(favorites_history_entry_s *entry)
@@ -67,47 +238,88 @@ int _favorites_free_history_entry(favorites_history_entry_s *entry)
 
 	return FAVORITES_ERROR_NONE;
 }
-/*************************************************************
- *	APIs for Internet favorites
- *************************************************************/
-int favorites_history_get_count(int *count)
+
+/* Runs a single-value query on the opened history db, -1 on failure */
+static long long _favorites_history_query_int64(const char *query)
 {
-	int nError;
 	sqlite3_stmt *stmt;
-	FAVORITES_LOGE("");
-		
-	if (_favorites_history_db_open() < 0) {
-		FAVORITES_LOGE("db_util_open is failed\n");
-		return FAVORITES_ERROR_DB_FAILED;
+	long long value = -1;
+
+	if (sqlite3_prepare_v2(gl_internet_history_db, query, -1, &stmt, NULL) != SQLITE_OK) {
+		FAVORITES_LOGE("sqlite3_prepare_v2 is failed.\n");
+		sqlite3_finalize(stmt);
+		return -1;
 	}
+	if (sqlite3_step(stmt) == SQLITE_ROW)
+		value = sqlite3_column_int64(stmt, 0);
+	sqlite3_finalize(stmt);
+	return value;
+}
+
+/* Reads one of the favorites_meta values on the opened db */
+int _favorites_history_get_meta(const char *name, sqlite3_int64 *value)
+{
+	int nError;
+	sqlite3_stmt *stmt;
 
-	/* folder + bookmark */
 	nError = sqlite3_prepare_v2(gl_internet_history_db,
-			       "select count(*) from history",
-			       -1, &stmt, NULL);
+			"select value from favorites_meta where name=?",
+			-1, &stmt, NULL);
 	if (nError != SQLITE_OK) {
 		FAVORITES_LOGE("sqlite3_prepare_v2 is failed.\n");
-		_favorites_history_db_finalize(stmt);
-		return FAVORITES_ERROR_DB_FAILED;
+		sqlite3_finalize(stmt);
+		return -1;
 	}
-
+	sqlite3_bind_text(stmt, 1, name, -1, NULL);
 	nError = sqlite3_step(stmt);
-	if (nError == SQLITE_ROW) {
-		*count = sqlite3_column_int(stmt, 0);
-		_favorites_history_db_finalize(stmt);
-		return FAVORITES_ERROR_NONE;
+	if (nError != SQLITE_ROW) {
+		sqlite3_finalize(stmt);
+		return -1;
+	}
+	*value = sqlite3_column_int64(stmt, 0);
+	sqlite3_finalize(stmt);
+	return 0;
+}
+
+/*************************************************************
+ *	APIs for Internet favorites
+ *************************************************************/
+int favorites_history_get_count(int *count)
+{
+	FAVORITES_API_ENTER();
+	long long value;
+	FAVORITES_LOGD("");
+	FAVORITES_NULL_ARG_CHECK(count);
+
+	_favorites_history_flush_visits();
+
+	if (_favorites_history_db_open() < 0) {
+		FAVORITES_LOGE("db_util_open is failed\n");
+		return FAVORITES_ERROR_DB_FAILED;
 	}
+
+	/* trigger-maintained count, scan if it is not there */
+	value = _favorites_history_query_int64(
+			"select value from favorites_meta where name='history_count'");
+	if (value < 0)
+		value = _favorites_history_query_int64("select count(*) from history");
 	_favorites_history_db_close();
-	return FAVORITES_ERROR_DB_FAILED;
+	if (value < 0)
+		return FAVORITES_ERROR_DB_FAILED;
+	*count = (int)value;
+	return FAVORITES_ERROR_NONE;
 }
 /* Public CAPI */
 int favorites_history_foreach(favorites_history_foreach_cb callback,void *user_data)
 {
+	FAVORITES_API_ENTER();
 	FAVORITES_NULL_ARG_CHECK(callback);
 	int nError;
 	int func_ret = 0;
 	sqlite3_stmt *stmt;
 
+	_favorites_history_flush_visits();
+
 	if (_favorites_history_db_open() < 0) {
 		FAVORITES_LOGE("db_util_open is failed\n");
 		return FAVORITES_ERROR_DB_FAILED;
@@ -134,7 +346,7 @@ int favorites_history_foreach(favorites_history_foreach_cb callback,void *user_d
 			if (length > 0) {
 				result.address = (char *)calloc(length + 1, sizeof(char));
 				memcpy(result.address, url, length);
-				FAVORITES_LOGE ("url:%s\n", url);
+				FAVORITES_LOGD ("url:%s\n", url);
 			}
 		}
 
@@ -159,7 +371,7 @@ int favorites_history_foreach(favorites_history_foreach_cb callback,void *user_d
 				    (char *)calloc(length + 1, sizeof(char));
 				memcpy(result.visit_date,
 				       visit_date, length);
-				FAVORITES_LOGE("Date:%s\n", result.visit_date);
+				FAVORITES_LOGD("Date:%s\n", result.visit_date);
 			}
 		}
 
@@ -175,11 +387,15 @@ int favorites_history_foreach(favorites_history_foreach_cb callback,void *user_d
 
 int favorites_history_delete_history(int id)
 {
+	FAVORITES_API_ENTER();
+	FAVORITES_WRITABLE_CHECK();
 	int nError;
 	sqlite3_stmt *stmt;
 
 	FAVORITES_INVALID_ARG_CHECK(id<0);
 
+	_favorites_history_flush_visits();
+
 	if (_favorites_history_db_open() < 0) {
 		FAVORITES_LOGE("db_util_open is failed\n");
 		return FAVORITES_ERROR_DB_FAILED;
@@ -210,6 +426,8 @@ int favorites_history_delete_history(int id)
 
 int favorites_history_delete_history_by_url(const char *url)
 {
+	FAVORITES_API_ENTER();
+	FAVORITES_WRITABLE_CHECK();
 	int nError;
 	sqlite3_stmt *stmt;
 
@@ -218,20 +436,25 @@ int favorites_history_delete_history_by_url(const char *url)
 		return FAVORITES_ERROR_INVALID_PARAMETER;
 	}
 		
+	_favorites_history_flush_visits();
+
 	if (_favorites_history_db_open() < 0) {
 		FAVORITES_LOGE("db_util_open is failed\n");
 		return FAVORITES_ERROR_DB_FAILED;
 	}
 
 	nError = sqlite3_prepare_v2(gl_internet_history_db,
-			        "delete from history where address=?", -1, &stmt, NULL);
+			        "delete from history where (url_hash=? or url_hash is null)\
+			        and address=?", -1, &stmt, NULL);
 	if (nError != SQLITE_OK) {
 		FAVORITES_LOGE("sqlite3_prepare_v2 is failed.\n");
 		_favorites_history_db_finalize(stmt);
 		return FAVORITES_ERROR_DB_FAILED;
 	}
 	// bind
-	if (sqlite3_bind_text(stmt, 1, url, -1, NULL) != SQLITE_OK)
+	if (sqlite3_bind_int64(stmt, 1, _favorites_db_url_hash(url)) != SQLITE_OK)
+		FAVORITES_LOGE("sqlite3_bind_int64 is failed.\n");
+	if (sqlite3_bind_text(stmt, 2, url, -1, NULL) != SQLITE_OK)
 		FAVORITES_LOGE("sqlite3_bind_text is failed.\n");
 	
 	nError = sqlite3_step(stmt);
@@ -246,9 +469,13 @@ int favorites_history_delete_history_by_url(const char *url)
 
 int favorites_history_delete_all_histories(void)
 {
+	FAVORITES_API_ENTER();
+	FAVORITES_WRITABLE_CHECK();
 	int nError;
 	sqlite3_stmt *stmt;
 
+	_favorites_history_flush_visits();
+
 	if (_favorites_history_db_open() < 0) {
 		FAVORITES_LOGE("db_util_open is failed\n");
 		return FAVORITES_ERROR_DB_FAILED;
@@ -274,11 +501,10 @@ int favorites_history_delete_all_histories(void)
 
 int favorites_history_delete_history_by_term(const char *begin, const char *end)
 {
+	FAVORITES_API_ENTER();
+	FAVORITES_WRITABLE_CHECK();
 	int nError;
 	sqlite3_stmt *stmt;
-	char	query[1024];
-
-	memset(&query, 0x00, sizeof(char)*1024);
 
 	if (!begin || (strlen(begin) <= 0)) {
 		FAVORITES_LOGE("begin date is empty\n");
@@ -290,25 +516,31 @@ int favorites_history_delete_history_by_term(const char *begin, const char *end)
 		end = "now";
 	}
 
-	sprintf(query, "delete from history where visitdate\
-		between datetime('%s') and datetime('%s')", begin, end);
-		
+	_favorites_history_flush_visits();
+
 	if (_favorites_history_db_open() < 0) {
 		FAVORITES_LOGE("db_util_open is failed\n");
 		return FAVORITES_ERROR_DB_FAILED;
 	}
 	nError = sqlite3_prepare_v2(gl_internet_history_db,
-			        query, -1, &stmt, NULL);
+			"delete from history where visitdate\
+			between datetime(?) and datetime(?)", -1, &stmt, NULL);
 
 	if (nError != SQLITE_OK) {
 		FAVORITES_LOGE("sqlite3_prepare_v2 is failed.\n");
 		_favorites_history_db_finalize(stmt);
 		return FAVORITES_ERROR_DB_FAILED;
 	}
+	if (sqlite3_bind_text(stmt, 1, begin, -1, NULL) != SQLITE_OK
+			|| sqlite3_bind_text(stmt, 2, end, -1, NULL) != SQLITE_OK) {
+		FAVORITES_LOGE("sqlite3_bind_text is failed.\n");
+		_favorites_history_db_finalize(stmt);
+		return FAVORITES_ERROR_DB_FAILED;
+	}
 
 	nError = sqlite3_step(stmt);
 	if (nError == SQLITE_OK || nError == SQLITE_DONE) {
-		FAVORITES_LOGE("sqlite3_step is DONE");
+		FAVORITES_LOGD("sqlite3_step is DONE");
 		_favorites_history_db_finalize(stmt);
 		return FAVORITES_ERROR_NONE;
 	}
@@ -318,3 +550,318 @@ int favorites_history_delete_history_by_term(const char *begin, const char *end)
 	return FAVORITES_ERROR_DB_FAILED;
 }
 
+int favorites_history_delete_history_by_term_incremental(const char *begin,
+		const char *end, int batch_size,
+		favorites_history_delete_progress_cb callback, void *user_data,
+		int *deleted_count)
+{
+	FAVORITES_API_ENTER();
+	FAVORITES_WRITABLE_CHECK();
+	int nError;
+	int total = 0;
+	int deleted = 0;
+	int finished = 0;
+	int ret = FAVORITES_ERROR_NONE;
+	sqlite3_stmt *stmt;
+
+	FAVORITES_INVALID_ARG_CHECK(batch_size<=0);
+
+	if (!begin || (strlen(begin) <= 0)) {
+		FAVORITES_LOGE("begin date is empty\n");
+		return FAVORITES_ERROR_INVALID_PARAMETER;
+	}
+
+	if (!end || (strlen(end) <= 0)) {
+		FAVORITES_LOGE("end date is empty\n");
+		end = "now";
+	}
+
+	_favorites_history_flush_visits();
+
+	if (_favorites_history_db_open() < 0) {
+		FAVORITES_LOGE("db_util_open is failed\n");
+		return FAVORITES_ERROR_DB_FAILED;
+	}
+
+	if (callback != NULL) {
+		/* the total is only an estimate for progress reporting, rows
+		 * may come and go while the batches run */
+		nError = sqlite3_prepare_v2(gl_internet_history_db,
+				"select count(*) from history where visitdate\
+				between datetime(?) and datetime(?)", -1, &stmt, NULL);
+		if (nError != SQLITE_OK) {
+			FAVORITES_LOGE("sqlite3_prepare_v2 is failed.\n");
+			_favorites_history_db_finalize(stmt);
+			return FAVORITES_ERROR_DB_FAILED;
+		}
+		sqlite3_bind_text(stmt, 1, begin, -1, NULL);
+		sqlite3_bind_text(stmt, 2, end, -1, NULL);
+		if (sqlite3_step(stmt) == SQLITE_ROW)
+			total = sqlite3_column_int(stmt, 0);
+		sqlite3_finalize(stmt);
+	}
+
+	/* Every batch runs in its own transaction, so the write lock is
+	 * released between batches and other writers can get in. */
+	nError = sqlite3_prepare_v2(gl_internet_history_db,
+			"delete from history where id in (select id from history\
+			where visitdate between datetime(?1) and datetime(?2)\
+			order by visitdate limit ?3)", -1, &stmt, NULL);
+	if (nError != SQLITE_OK) {
+		FAVORITES_LOGE("sqlite3_prepare_v2 is failed.\n");
+		_favorites_history_db_finalize(stmt);
+		return FAVORITES_ERROR_DB_FAILED;
+	}
+	if (sqlite3_bind_text(stmt, 1, begin, -1, NULL) != SQLITE_OK
+			|| sqlite3_bind_text(stmt, 2, end, -1, NULL) != SQLITE_OK
+			|| sqlite3_bind_int(stmt, 3, batch_size) != SQLITE_OK) {
+		FAVORITES_LOGE("sqlite3_bind is failed.\n");
+		_favorites_history_db_finalize(stmt);
+		return FAVORITES_ERROR_DB_FAILED;
+	}
+
+	while (1) {
+		int changes;
+
+		nError = sqlite3_step(stmt);
+		sqlite3_reset(stmt);
+		if (nError != SQLITE_DONE) {
+			FAVORITES_LOGE("sqlite3_step is failed");
+			ret = FAVORITES_ERROR_DB_FAILED;
+			break;
+		}
+		changes = sqlite3_changes(gl_internet_history_db);
+		deleted += changes;
+		if (changes < batch_size) {
+			finished = 1;
+			break;
+		}
+		if (total < deleted)
+			total = deleted;
+		if (callback != NULL && !callback(deleted, total, user_data))
+			break;
+	}
+	_favorites_history_db_finalize(stmt);
+
+	/* the last report always has deleted_count == total_count */
+	if (callback != NULL && finished)
+		callback(deleted, deleted, user_data);
+	if (deleted_count != NULL)
+		*deleted_count = deleted;
+	return ret;
+}
+
+int favorites_history_foreach_host(favorites_history_host_order_e order, int limit,
+		favorites_history_host_cb callback, void *user_data)
+{
+	FAVORITES_API_ENTER();
+	FAVORITES_NULL_ARG_CHECK(callback);
+	FAVORITES_INVALID_ARG_CHECK(limit<0);
+	int nError;
+	int func_ret = 0;
+	sqlite3_stmt *stmt;
+	const char *query;
+
+	switch (order) {
+	case FAVORITES_HISTORY_HOST_ORDER_MOST_VISITED:
+		query = "select host, visits, pages, last_visit from favorites_history_hosts\
+			order by visits desc, last_visit desc limit ?";
+		break;
+	case FAVORITES_HISTORY_HOST_ORDER_RECENTLY_VISITED:
+		query = "select host, visits, pages, last_visit from favorites_history_hosts\
+			order by last_visit desc, visits desc limit ?";
+		break;
+	case FAVORITES_HISTORY_HOST_ORDER_MOST_PAGES:
+		query = "select host, visits, pages, last_visit from favorites_history_hosts\
+			order by pages desc, visits desc limit ?";
+		break;
+	default:
+		FAVORITES_LOGE("unknown order %d\n", order);
+		return FAVORITES_ERROR_INVALID_PARAMETER;
+	}
+
+	_favorites_history_flush_visits();
+
+	if (_favorites_history_db_open() < 0) {
+		FAVORITES_LOGE("db_util_open is failed\n");
+		return FAVORITES_ERROR_DB_FAILED;
+	}
+	nError = sqlite3_prepare_v2(gl_internet_history_db, query, -1, &stmt, NULL);
+	if (nError != SQLITE_OK) {
+		FAVORITES_LOGE ("sqlite3_prepare_v2 is failed.\n");
+		_favorites_history_db_finalize(stmt);
+		return FAVORITES_ERROR_DB_FAILED;
+	}
+	/* a negative limit is no limit for sqlite */
+	sqlite3_bind_int(stmt, 1, limit > 0 ? limit : -1);
+
+	while ((nError = sqlite3_step(stmt)) == SQLITE_ROW) {
+		favorites_history_host_s result;
+		/* the strings stay valid until the next step */
+		result.host = (char *)sqlite3_column_text(stmt, 0);
+		result.visit_count = sqlite3_column_int(stmt, 1);
+		result.page_count = sqlite3_column_int(stmt, 2);
+		result.last_visit_date = (char *)sqlite3_column_text(stmt, 3);
+
+		func_ret = callback(&result, user_data);
+		if(func_ret == 0)
+			break;
+	}
+	if (nError != SQLITE_ROW && nError != SQLITE_DONE) {
+		FAVORITES_LOGE("sqlite3_step is failed");
+		_favorites_history_db_finalize(stmt);
+		return FAVORITES_ERROR_DB_FAILED;
+	}
+	_favorites_history_db_finalize(stmt);
+	return FAVORITES_ERROR_NONE;
+}
+
+int favorites_history_set_retention_policy(int max_age_days, int max_count,
+		long long max_size, favorites_history_retention_order_e order)
+{
+	FAVORITES_INVALID_ARG_CHECK(max_age_days<0);
+	FAVORITES_INVALID_ARG_CHECK(max_count<0);
+	FAVORITES_INVALID_ARG_CHECK(max_size<0);
+	FAVORITES_INVALID_ARG_CHECK(order != FAVORITES_HISTORY_RETENTION_OLDEST_FIRST
+			&& order != FAVORITES_HISTORY_RETENTION_LEAST_FRECENT_FIRST);
+
+	pthread_mutex_lock(&gl_history_retention_lock);
+	gl_history_retention_max_age = max_age_days;
+	gl_history_retention_max_count = max_count;
+	gl_history_retention_max_size = max_size;
+	gl_history_retention_order = order;
+	pthread_mutex_unlock(&gl_history_retention_lock);
+	return FAVORITES_ERROR_NONE;
+}
+
+/* Deletes up to limit histories in the retention order, one transaction.
+ * Returns the number of deleted rows or -1. */
+static int _favorites_history_prune(favorites_history_retention_order_e order, int limit)
+{
+	int nError;
+	sqlite3_stmt *stmt;
+
+	if (order == FAVORITES_HISTORY_RETENTION_LEAST_FRECENT_FIRST) {
+		/* frecency: visits weighted down by the days since the last one */
+		nError = sqlite3_prepare_v2(gl_internet_history_db,
+				"delete from history where id in (select id from history\
+				order by counter / (1.0 + julianday('now') - julianday(visitdate)),\
+				visitdate limit ?)", -1, &stmt, NULL);
+	} else {
+		nError = sqlite3_prepare_v2(gl_internet_history_db,
+				"delete from history where id in (select id from history\
+				order by visitdate limit ?)", -1, &stmt, NULL);
+	}
+	if (nError != SQLITE_OK) {
+		FAVORITES_LOGE("sqlite3_prepare_v2 is failed.\n");
+		sqlite3_finalize(stmt);
+		return -1;
+	}
+	sqlite3_bind_int(stmt, 1, limit);
+	nError = sqlite3_step(stmt);
+	sqlite3_finalize(stmt);
+	if (nError != SQLITE_DONE) {
+		FAVORITES_LOGE("sqlite3_step is failed");
+		return -1;
+	}
+	return sqlite3_changes(gl_internet_history_db);
+}
+
+int favorites_history_maintain(int budget, int *deleted_count)
+{
+	FAVORITES_API_ENTER();
+	FAVORITES_WRITABLE_CHECK();
+	int nError;
+	int deleted = 0;
+	int changes;
+	int max_age;
+	int max_count;
+	long long max_size;
+	favorites_history_retention_order_e order;
+	sqlite3_stmt *stmt;
+
+	FAVORITES_INVALID_ARG_CHECK(budget<0);
+	if (budget == 0)
+		budget = HISTORY_MAINTAIN_DEFAULT_BUDGET;
+
+	pthread_mutex_lock(&gl_history_retention_lock);
+	max_age = gl_history_retention_max_age;
+	max_count = gl_history_retention_max_count;
+	max_size = gl_history_retention_max_size;
+	order = gl_history_retention_order;
+	pthread_mutex_unlock(&gl_history_retention_lock);
+
+	if (deleted_count != NULL)
+		*deleted_count = 0;
+	if (max_age == 0 && max_count == 0 && max_size == 0)
+		return FAVORITES_ERROR_NONE;
+
+	_favorites_history_flush_visits();
+
+	if (_favorites_history_db_open() < 0) {
+		FAVORITES_LOGE("db_util_open is failed\n");
+		return FAVORITES_ERROR_DB_FAILED;
+	}
+
+	/* expired histories go first, whatever the order */
+	if (max_age > 0) {
+		char modifier[32];
+
+		snprintf(modifier, sizeof(modifier), "-%d days", max_age);
+		nError = sqlite3_prepare_v2(gl_internet_history_db,
+				"delete from history where id in (select id from history\
+				where visitdate < datetime('now', ?) order by visitdate limit ?)",
+				-1, &stmt, NULL);
+		if (nError != SQLITE_OK) {
+			FAVORITES_LOGE("sqlite3_prepare_v2 is failed.\n");
+			_favorites_history_db_finalize(stmt);
+			return FAVORITES_ERROR_DB_FAILED;
+		}
+		sqlite3_bind_text(stmt, 1, modifier, -1, SQLITE_TRANSIENT);
+		sqlite3_bind_int(stmt, 2, budget);
+		nError = sqlite3_step(stmt);
+		sqlite3_finalize(stmt);
+		if (nError != SQLITE_DONE) {
+			FAVORITES_LOGE("sqlite3_step is failed");
+			_favorites_history_db_close();
+			return FAVORITES_ERROR_DB_FAILED;
+		}
+		deleted += sqlite3_changes(gl_internet_history_db);
+	}
+
+	if (max_count > 0 && deleted < budget) {
+		long long count = _favorites_history_query_int64("select count(*) from history");
+		if (count > max_count) {
+			int excess = count - max_count;
+			changes = _favorites_history_prune(order,
+					excess < budget - deleted ? excess : budget - deleted);
+			if (changes < 0) {
+				_favorites_history_db_close();
+				return FAVORITES_ERROR_DB_FAILED;
+			}
+			deleted += changes;
+		}
+	}
+
+	if (max_size > 0 && deleted < budget) {
+		/* pages on the freelist are reusable, they do not count */
+		long long page_size = _favorites_history_query_int64("pragma page_size");
+		long long pages = _favorites_history_query_int64("pragma page_count");
+		long long free_pages = _favorites_history_query_int64("pragma freelist_count");
+
+		if (page_size > 0 && pages >= 0 && free_pages >= 0
+				&& (pages - free_pages) * page_size > max_size) {
+			changes = _favorites_history_prune(order, budget - deleted);
+			if (changes < 0) {
+				_favorites_history_db_close();
+				return FAVORITES_ERROR_DB_FAILED;
+			}
+			deleted += changes;
+		}
+	}
+
+	_favorites_history_db_close();
+	if (deleted_count != NULL)
+		*deleted_count = deleted;
+	return FAVORITES_ERROR_NONE;
+}
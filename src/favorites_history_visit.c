@@ -0,0 +1,295 @@
+/*
+ * Copyright (c) 2011 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <dlog.h>
+#include <db-util.h>
+#include <favorites.h>
+#include <favorites_private.h>
+
+extern __thread sqlite3 *gl_internet_history_db;
+
+/*
+ * Write-behind buffer of recorded visits. Visits of the same url are merged
+ * into one entry, and the whole buffer is written in one transaction once
+ * it holds HISTORY_VISIT_BUFFER_SIZE urls, or when a visit is recorded
+ * HISTORY_VISIT_FLUSH_INTERVAL seconds or more after the oldest one. There
+ * is no timer: the interval is only checked by record_visit, so visits
+ * stay buffered until the next visit or favorites_history_flush().
+ */
+#define HISTORY_VISIT_BUFFER_SIZE	32
+#define HISTORY_VISIT_FLUSH_INTERVAL	10
+#define HISTORY_VISIT_BUCKETS		64
+
+struct history_visit {
+	char *address;
+	char *title;
+	sqlite3_int64 url_hash;
+	int count;
+	time_t visitdate;
+	struct history_visit *next;
+};
+typedef struct history_visit history_visit_s;
+
+static pthread_mutex_t gl_history_visit_lock = PTHREAD_MUTEX_INITIALIZER;
+/* serializes the writers, so that visits reach the db in order */
+static pthread_mutex_t gl_history_visit_flush_lock = PTHREAD_MUTEX_INITIALIZER;
+static history_visit_s *gl_history_visit_table[HISTORY_VISIT_BUCKETS];
+static int gl_history_visit_count = 0;
+static time_t gl_history_visit_oldest = 0;
+
+static void _favorites_history_visit_free(history_visit_s *visit)
+{
+	free(visit->address);
+	free(visit->title);
+	free(visit);
+}
+
+/* Merges a visit into the buffer, called with gl_history_visit_lock held */
+static int _favorites_history_visit_merge(const char *url, sqlite3_int64 url_hash,
+		const char *title, int count, time_t visitdate)
+{
+	history_visit_s *visit;
+	history_visit_s **bucket = &gl_history_visit_table[
+			(unsigned long long)url_hash % HISTORY_VISIT_BUCKETS];
+
+	for (visit = *bucket; visit != NULL; visit = visit->next) {
+		if (visit->url_hash == url_hash && !strcmp(visit->address, url))
+			break;
+	}
+	if (visit == NULL) {
+		visit = (history_visit_s *)calloc(1, sizeof(history_visit_s));
+		if (visit == NULL)
+			return -1;
+		visit->address = strdup(url);
+		if (visit->address == NULL) {
+			free(visit);
+			return -1;
+		}
+		visit->url_hash = url_hash;
+		visit->next = *bucket;
+		*bucket = visit;
+		if (gl_history_visit_count++ == 0)
+			gl_history_visit_oldest = visitdate;
+	}
+	/* the latest title wins */
+	if (title != NULL && title[0] != '\0') {
+		char *copy = strdup(title);
+		if (copy != NULL) {
+			free(visit->title);
+			visit->title = copy;
+		}
+	}
+	visit->count += count;
+	if (visitdate > visit->visitdate)
+		visit->visitdate = visitdate;
+	return 0;
+}
+
+/* Detaches every buffered visit, called with gl_history_visit_lock held */
+static history_visit_s *_favorites_history_visit_take(void)
+{
+	history_visit_s *list = NULL;
+	history_visit_s *visit;
+	int i;
+
+	for (i = 0; i < HISTORY_VISIT_BUCKETS; i++) {
+		while ((visit = gl_history_visit_table[i]) != NULL) {
+			gl_history_visit_table[i] = visit->next;
+			visit->next = list;
+			list = visit;
+		}
+	}
+	gl_history_visit_count = 0;
+	return list;
+}
+
+/* Adds the visit to its history row, or inserts one, on the opened db */
+static int _favorites_history_visit_write(sqlite3_stmt *update, sqlite3_stmt *insert,
+		history_visit_s *visit)
+{
+	sqlite3_reset(update);
+	sqlite3_bind_int(update, 1, visit->count);
+	sqlite3_bind_int64(update, 2, (sqlite3_int64)visit->visitdate);
+	sqlite3_bind_text(update, 3, visit->title, -1, NULL);
+	sqlite3_bind_int64(update, 4, visit->url_hash);
+	sqlite3_bind_text(update, 5, visit->address, -1, NULL);
+	if (sqlite3_step(update) != SQLITE_DONE) {
+		FAVORITES_LOGE("sqlite3_step is failed");
+		return -1;
+	}
+	if (sqlite3_changes(gl_internet_history_db) > 0)
+		return 0;
+
+	sqlite3_reset(insert);
+	sqlite3_bind_text(insert, 1, visit->address, -1, NULL);
+	sqlite3_bind_text(insert, 2, visit->title, -1, NULL);
+	sqlite3_bind_int(insert, 3, visit->count);
+	sqlite3_bind_int64(insert, 4, (sqlite3_int64)visit->visitdate);
+	sqlite3_bind_int64(insert, 5, visit->url_hash);
+	if (sqlite3_step(insert) != SQLITE_DONE) {
+		FAVORITES_LOGE("sqlite3_step is failed");
+		return -1;
+	}
+	return 0;
+}
+
+static int _favorites_history_visit_write_all(history_visit_s *list)
+{
+	int ret = 0;
+	int rows = 0;
+	sqlite3_stmt *update = NULL;
+	sqlite3_stmt *insert = NULL;
+	history_visit_s *visit;
+	FAVORITES_TRACE_BEGIN(FAVORITES_TRACE_LEVEL_DEBUG, trace_start);
+
+	if (_favorites_history_db_open() < 0) {
+		FAVORITES_LOGE("db_util_open is failed\n");
+		return -1;
+	}
+	if (_favorites_db_exec(gl_internet_history_db, "begin immediate") < 0) {
+		_favorites_history_db_close();
+		return -1;
+	}
+
+	/* the browser keeps one row per address, possibly without url_hash */
+	if (sqlite3_prepare_v2(gl_internet_history_db,
+			"update history set counter=counter+?1,\
+			visitdate=max(coalesce(visitdate, ''), datetime(?2, 'unixepoch')),\
+			title=coalesce(?3, title)\
+			where (url_hash=?4 or url_hash is null) and address=?5",
+			-1, &update, NULL) != SQLITE_OK
+			|| sqlite3_prepare_v2(gl_internet_history_db,
+			"insert into history(address, title, counter, visitdate, url_hash)\
+			values(?1, ?2, ?3, datetime(?4, 'unixepoch'), ?5)",
+			-1, &insert, NULL) != SQLITE_OK) {
+		FAVORITES_LOGE("sqlite3_prepare_v2 is failed.\n");
+		ret = -1;
+	}
+	for (visit = list; ret == 0 && visit != NULL; visit = visit->next, rows++)
+		ret = _favorites_history_visit_write(update, insert, visit);
+	sqlite3_finalize(update);
+	sqlite3_finalize(insert);
+
+	if (ret == 0)
+		ret = _favorites_db_exec(gl_internet_history_db, "commit");
+	if (ret < 0)
+		sqlite3_exec(gl_internet_history_db, "rollback", NULL, NULL, NULL);
+	_favorites_history_db_close();
+	FAVORITES_TRACE_END(trace_start, "visit flush", ret == 0 ? rows : -1);
+	return ret;
+}
+
+/* Writes the buffered visits. On failure they are merged back into the
+ * buffer, to be written with the next flush. Every history read and delete
+ * flushes first, so that buffered visits are neither missing from a read
+ * nor brought back after a delete. */
+int _favorites_history_flush_visits(void)
+{
+	history_visit_s *list;
+	history_visit_s *visit;
+	int ret;
+
+	pthread_mutex_lock(&gl_history_visit_flush_lock);
+	pthread_mutex_lock(&gl_history_visit_lock);
+	list = _favorites_history_visit_take();
+	pthread_mutex_unlock(&gl_history_visit_lock);
+
+	if (list == NULL) {
+		pthread_mutex_unlock(&gl_history_visit_flush_lock);
+		return 0;
+	}
+	ret = _favorites_history_visit_write_all(list);
+
+	pthread_mutex_lock(&gl_history_visit_lock);
+	while ((visit = list) != NULL) {
+		list = visit->next;
+		if (ret < 0)
+			_favorites_history_visit_merge(visit->address, visit->url_hash,
+					visit->title, visit->count, visit->visitdate);
+		_favorites_history_visit_free(visit);
+	}
+	pthread_mutex_unlock(&gl_history_visit_lock);
+	pthread_mutex_unlock(&gl_history_visit_flush_lock);
+	return ret;
+}
+
+/* Calls callback with the url hash of every buffered visit */
+void _favorites_history_foreach_visit_hash(void (*callback)(sqlite3_int64 url_hash))
+{
+	history_visit_s *visit;
+	int i;
+
+	pthread_mutex_lock(&gl_history_visit_lock);
+	for (i = 0; i < HISTORY_VISIT_BUCKETS; i++) {
+		for (visit = gl_history_visit_table[i]; visit != NULL; visit = visit->next)
+			callback(visit->url_hash);
+	}
+	pthread_mutex_unlock(&gl_history_visit_lock);
+}
+
+/* visits still buffered when the process exits or the library is unloaded */
+__attribute__((destructor))
+static void _favorites_history_visit_fini(void)
+{
+	if (_favorites_history_flush_visits() < 0)
+		FAVORITES_LOGE("buffered visits are lost\n");
+}
+
+/*************************************************************
+ *	APIs for Internet favorites
+ *************************************************************/
+int favorites_history_record_visit(const char *url, const char *title)
+{
+	FAVORITES_API_ENTER();
+	FAVORITES_WRITABLE_CHECK();
+	int ret;
+	int flush;
+	sqlite3_int64 url_hash;
+	time_t now = time(NULL);
+
+	if (!url || (strlen(url) <= 0)) {
+		FAVORITES_LOGE("url is empty\n");
+		return FAVORITES_ERROR_INVALID_PARAMETER;
+	}
+
+	url_hash = _favorites_db_url_hash(url);
+	pthread_mutex_lock(&gl_history_visit_lock);
+	ret = _favorites_history_visit_merge(url, url_hash, title, 1, now);
+	flush = gl_history_visit_count >= HISTORY_VISIT_BUFFER_SIZE
+		|| now - gl_history_visit_oldest >= HISTORY_VISIT_FLUSH_INTERVAL;
+	pthread_mutex_unlock(&gl_history_visit_lock);
+	if (ret < 0) {
+		FAVORITES_LOGE("out of memory\n");
+		return FAVORITES_ERROR_DB_FAILED;
+	}
+	_favorites_url_filter_add(url_hash);
+
+	/* the visit stays buffered if this fails, the next flush retries */
+	if (flush && _favorites_history_flush_visits() < 0)
+		return FAVORITES_ERROR_DB_FAILED;
+	return FAVORITES_ERROR_NONE;
+}
+
+int favorites_history_flush(void)
+{
+	FAVORITES_API_ENTER();
+	if (_favorites_history_flush_visits() < 0)
+		return FAVORITES_ERROR_DB_FAILED;
+	return FAVORITES_ERROR_NONE;
+}
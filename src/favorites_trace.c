@@ -0,0 +1,190 @@
+/*
+ * Copyright (c) 2011 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <dlog.h>
+#include <db-util.h>
+#include <favorites.h>
+#include <favorites_private.h>
+
+/*
+ * Trace events are written by each thread into its own ring, without a
+ * lock: the slot is filled, then head is published. A reader copies the
+ * ring and drops the slots which head passed over during the copy, and
+ * the one the writer may be filling. The rings are listed for
+ * favorites_trace_foreach_event() and freed when their thread exits.
+ */
+#define TRACE_RING_SIZE	256	/* power of two */
+
+struct trace_ring {
+	favorites_trace_event_s events[TRACE_RING_SIZE];
+	volatile unsigned int head;	/* number of events written so far */
+	struct trace_ring *next;
+};
+typedef struct trace_ring trace_ring_s;
+
+/* read by the FAVORITES_LOG* and FAVORITES_TRACE* macros */
+int gl_favorites_trace_level = FAVORITES_TRACE_LEVEL_ERROR;
+
+static pthread_mutex_t gl_trace_rings_lock = PTHREAD_MUTEX_INITIALIZER;
+static trace_ring_s *gl_trace_rings = NULL;
+static pthread_once_t gl_trace_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t gl_trace_key;
+static __thread trace_ring_s *gl_trace_ring = NULL;
+
+static void _favorites_trace_ring_free(void *data)
+{
+	trace_ring_s *ring = (trace_ring_s *)data;
+	trace_ring_s **p;
+
+	pthread_mutex_lock(&gl_trace_rings_lock);
+	for (p = &gl_trace_rings; *p != NULL; p = &(*p)->next) {
+		if (*p == ring) {
+			*p = ring->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&gl_trace_rings_lock);
+	free(ring);
+}
+
+static void _favorites_trace_key_init(void)
+{
+	pthread_key_create(&gl_trace_key, _favorites_trace_ring_free);
+}
+
+static trace_ring_s *_favorites_trace_ring(void)
+{
+	trace_ring_s *ring = gl_trace_ring;
+
+	if (ring != NULL)
+		return ring;
+	ring = (trace_ring_s *)calloc(1, sizeof(trace_ring_s));
+	if (ring == NULL)
+		return NULL;
+	pthread_once(&gl_trace_key_once, _favorites_trace_key_init);
+	pthread_setspecific(gl_trace_key, ring);
+
+	pthread_mutex_lock(&gl_trace_rings_lock);
+	ring->next = gl_trace_rings;
+	gl_trace_rings = ring;
+	pthread_mutex_unlock(&gl_trace_rings_lock);
+	gl_trace_ring = ring;
+	return ring;
+}
+
+unsigned long long _favorites_trace_now(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (unsigned long long)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/* Records an event which started at start, a _favorites_trace_now() time.
+ * api and phase must be string literals or __FUNCTION__. */
+void _favorites_trace_event(const char *api, const char *phase,
+		unsigned long long start, int rows)
+{
+	trace_ring_s *ring = _favorites_trace_ring();
+	favorites_trace_event_s *event;
+	unsigned int head;
+
+	if (ring == NULL)
+		return;
+	head = ring->head;
+	event = &ring->events[head & (TRACE_RING_SIZE - 1)];
+	event->api = api;
+	event->phase = phase;
+	event->start_us = start;
+	event->duration_us = (unsigned int)(_favorites_trace_now() - start);
+	event->rows = rows;
+	event->thread_id = (unsigned long)pthread_self();
+	__sync_synchronize();
+	ring->head = head + 1;
+}
+
+/* Appends the events of ring still valid after the copy, called with
+ * gl_trace_rings_lock held */
+static int _favorites_trace_ring_copy(trace_ring_s *ring, favorites_trace_event_s *copy)
+{
+	unsigned int head = ring->head;
+	unsigned int first = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+	unsigned int i;
+	int count = 0;
+
+	__sync_synchronize();
+	for (i = first; i != head; i++)
+		copy[count++] = ring->events[i & (TRACE_RING_SIZE - 1)];
+	__sync_synchronize();
+	head = ring->head;
+	/* the writer may have reused the oldest slots meanwhile, and be
+	 * filling the slot after the last one it published */
+	if (head - first >= TRACE_RING_SIZE) {
+		unsigned int lost = head + 1 - first - TRACE_RING_SIZE;
+		if (lost >= (unsigned int)count)
+			return 0;
+		memmove(copy, copy + lost, (count - lost) * sizeof(favorites_trace_event_s));
+		count -= lost;
+	}
+	return count;
+}
+
+/*************************************************************
+ *	APIs for Internet favorites
+ *************************************************************/
+int favorites_trace_set_level(favorites_trace_level_e level)
+{
+	FAVORITES_INVALID_ARG_CHECK(level<FAVORITES_TRACE_LEVEL_NONE);
+	FAVORITES_INVALID_ARG_CHECK(level>FAVORITES_TRACE_LEVEL_DEBUG);
+
+	gl_favorites_trace_level = level;
+	return FAVORITES_ERROR_NONE;
+}
+
+int favorites_trace_foreach_event(favorites_trace_event_cb callback, void *user_data)
+{
+	FAVORITES_NULL_ARG_CHECK(callback);
+	favorites_trace_event_s *copy;
+	trace_ring_s *ring;
+	int rings = 0;
+	int count = 0;
+	int i;
+
+	/* the callback runs unlocked, on a copy */
+	pthread_mutex_lock(&gl_trace_rings_lock);
+	for (ring = gl_trace_rings; ring != NULL; ring = ring->next)
+		rings++;
+	copy = (favorites_trace_event_s *)malloc(
+			(rings > 0 ? rings : 1) * TRACE_RING_SIZE * sizeof(favorites_trace_event_s));
+	if (copy == NULL) {
+		pthread_mutex_unlock(&gl_trace_rings_lock);
+		FAVORITES_LOGE("out of memory\n");
+		return FAVORITES_ERROR_DB_FAILED;
+	}
+	for (ring = gl_trace_rings; ring != NULL; ring = ring->next)
+		count += _favorites_trace_ring_copy(ring, copy + count);
+	pthread_mutex_unlock(&gl_trace_rings_lock);
+
+	for (i = 0; i < count; i++) {
+		if (!callback(&copy[i], user_data))
+			break;
+	}
+	free(copy);
+	return FAVORITES_ERROR_NONE;
+}
@@ -0,0 +1,499 @@
+/*
+ * Copyright (c) 2011 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <dlog.h>
+#include <db-util.h>
+#include <favorites.h>
+#include <favorites_private.h>
+
+extern __thread sqlite3 *gl_internet_bookmark_db;
+extern __thread sqlite3 *gl_internet_history_db;
+
+/*
+ * Bloom filter over the url hashes of the bookmarks and the history. It is
+ * built on first use and sized for twice the urls of that time. Urls added
+ * through the library are set at once; the urls_version counters of both
+ * dbs are checked at most every URL_FILTER_CHECK_INTERVAL seconds, and
+ * when they moved only the rows past the highest id already loaded are
+ * added. The filter is rebuilt when it is full, when the rate changes,
+ * when an address was changed in place (urls_changed), or on every change
+ * if a table may reuse the ids of deleted rows. Deleted urls stay set
+ * until the next rebuild, which only costs false positives.
+ */
+#define URL_FILTER_DEFAULT_RATE		0.01
+#define URL_FILTER_MIN_CAPACITY		1024
+#define URL_FILTER_MAX_HASHES		16
+#define URL_FILTER_CHECK_INTERVAL	1
+
+struct url_hash_array {
+	sqlite3_int64 *hash;
+	int count;
+	int size;
+};
+typedef struct url_hash_array url_hash_array_s;
+
+static pthread_mutex_t gl_url_filter_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned char *gl_url_filter_bits = NULL;	/* NULL until built */
+static unsigned long long gl_url_filter_nbits = 0;
+static int gl_url_filter_hashes = 0;
+static int gl_url_filter_capacity = 0;
+static int gl_url_filter_count = 0;
+static double gl_url_filter_rate = URL_FILTER_DEFAULT_RATE;
+static sqlite3_int64 gl_url_filter_bookmark_version = 0;
+static sqlite3_int64 gl_url_filter_history_version = 0;
+static sqlite3_int64 gl_url_filter_changes = 0;	/* urls_changed of both dbs */
+static sqlite3_int64 gl_url_filter_bookmark_rowid = 0;	/* highest id loaded */
+static sqlite3_int64 gl_url_filter_history_rowid = 0;
+static int gl_url_filter_incremental = 0;	/* both tables are AUTOINCREMENT */
+static time_t gl_url_filter_checked = 0;
+
+/* log2(1 / rate), close enough for sizing and without libm */
+static double _favorites_url_filter_log2_inverse(double rate)
+{
+	double bits = 0;
+
+	while (rate < 0.5) {
+		rate *= 2;
+		bits += 1;
+	}
+	return bits + 2 * (1 - rate);
+}
+
+/* Sets or tests the bits of a hash, called with gl_url_filter_lock held */
+static int _favorites_url_filter_bits(sqlite3_int64 url_hash, int set)
+{
+	unsigned long long hash = (unsigned long long)url_hash;
+	unsigned int h1 = (unsigned int)hash;
+	unsigned int h2 = (unsigned int)(hash >> 32) | 1;
+	unsigned long long bit;
+	int i;
+
+	for (i = 0; i < gl_url_filter_hashes; i++) {
+		bit = (h1 + (unsigned long long)i * h2) % gl_url_filter_nbits;
+		if (set)
+			gl_url_filter_bits[bit >> 3] |= 1 << (bit & 7);
+		else if (!(gl_url_filter_bits[bit >> 3] & (1 << (bit & 7))))
+			return 0;
+	}
+	return 1;
+}
+
+/* Sets a buffered visit, called with gl_url_filter_lock held */
+static void _favorites_url_filter_set_visit(sqlite3_int64 url_hash)
+{
+	_favorites_url_filter_bits(url_hash, 1);
+}
+
+/* Appends the url hash of every (url_hash, address, id) row the query
+ * returns for rows after *rowid, and moves *rowid to the highest id seen */
+static int _favorites_url_filter_collect(sqlite3 *db, const char *query,
+		sqlite3_int64 *rowid, url_hash_array_s *array)
+{
+	sqlite3_stmt *stmt;
+	sqlite3_int64 max_rowid = *rowid;
+	int nError;
+
+	if (sqlite3_prepare_v2(db, query, -1, &stmt, NULL) != SQLITE_OK) {
+		FAVORITES_LOGE("sqlite3_prepare_v2 is failed.\n");
+		sqlite3_finalize(stmt);
+		return -1;
+	}
+	sqlite3_bind_int64(stmt, 1, *rowid);
+	while ((nError = sqlite3_step(stmt)) == SQLITE_ROW) {
+		if (sqlite3_column_int64(stmt, 2) > max_rowid)
+			max_rowid = sqlite3_column_int64(stmt, 2);
+		if (array->count == array->size) {
+			int size = array->size ? array->size * 2 : URL_FILTER_MIN_CAPACITY;
+			sqlite3_int64 *hash = (sqlite3_int64 *)realloc(array->hash,
+					size * sizeof(sqlite3_int64));
+			if (hash == NULL) {
+				sqlite3_finalize(stmt);
+				return -1;
+			}
+			array->hash = hash;
+			array->size = size;
+		}
+		/* rows written by the browser may not have their hash yet */
+		if (sqlite3_column_type(stmt, 0) == SQLITE_NULL)
+			array->hash[array->count++] = _favorites_db_url_hash(
+					(const char *)sqlite3_column_text(stmt, 1));
+		else
+			array->hash[array->count++] = sqlite3_column_int64(stmt, 0);
+	}
+	sqlite3_finalize(stmt);
+	if (nError != SQLITE_DONE) {
+		FAVORITES_LOGE("sqlite3_step is failed");
+		return -1;
+	}
+	*rowid = max_rowid;
+	return 0;
+}
+
+/* Whether the ids of table only grow, i.e. it is AUTOINCREMENT, on the
+ * opened db. Returns 1, 0 or -1. */
+static int _favorites_url_filter_ids_grow(sqlite3 *db, const char *table)
+{
+	sqlite3_stmt *stmt;
+	int nError;
+
+	if (sqlite3_prepare_v2(db, "select 1 from sqlite_master where type='table'\
+			and name=? and sql like '%autoincrement%'", -1, &stmt, NULL) != SQLITE_OK) {
+		FAVORITES_LOGE("sqlite3_prepare_v2 is failed.\n");
+		sqlite3_finalize(stmt);
+		return -1;
+	}
+	sqlite3_bind_text(stmt, 1, table, -1, NULL);
+	nError = sqlite3_step(stmt);
+	sqlite3_finalize(stmt);
+	if (nError != SQLITE_ROW && nError != SQLITE_DONE)
+		return -1;
+	return nError == SQLITE_ROW;
+}
+
+/* Collects the urls of both dbs after the given ids, and tells whether
+ * later loads may be incremental. Returns 0 or -1. */
+static int _favorites_url_filter_load(sqlite3_int64 *bookmark_rowid,
+		sqlite3_int64 *history_rowid, int *incremental, url_hash_array_s *array)
+{
+	int ret = -1;
+	int bookmark_ids_grow = 0;
+	int history_ids_grow = 0;
+
+	if (_favorites_open_bookmark_db() == 0) {
+		ret = _favorites_url_filter_collect(gl_internet_bookmark_db,
+				"select url_hash, address, id from bookmarks\
+				where type=0 and address is not null and id > ?",
+				bookmark_rowid, array);
+		if (ret == 0 && incremental != NULL)
+			bookmark_ids_grow = _favorites_url_filter_ids_grow(gl_internet_bookmark_db, "bookmarks");
+	}
+	_favorites_close_bookmark_db();
+	if (ret < 0)
+		return -1;
+
+	ret = -1;
+	if (_favorites_history_db_open() == 0) {
+		ret = _favorites_url_filter_collect(gl_internet_history_db,
+				"select url_hash, address, id from history\
+				where address is not null and id > ?",
+				history_rowid, array);
+		if (ret == 0 && incremental != NULL)
+			history_ids_grow = _favorites_url_filter_ids_grow(gl_internet_history_db, "history");
+	}
+	_favorites_history_db_close();
+	if (ret < 0)
+		return -1;
+
+	if (incremental != NULL)
+		*incremental = bookmark_ids_grow > 0 && history_ids_grow > 0;
+	return 0;
+}
+
+/* Reads the urls_version of both dbs and the sum of their urls_changed,
+ * -1 when a db does not count the changes yet. Returns 0 or -1. */
+static int _favorites_url_filter_versions(sqlite3_int64 *bookmark_version,
+		sqlite3_int64 *history_version, sqlite3_int64 *changes)
+{
+	sqlite3_int64 bookmark_changes = -1;
+	sqlite3_int64 history_changes = -1;
+	int ret;
+
+	if (_favorites_open_bookmark_db() < 0) {
+		FAVORITES_LOGE("db_util_open is failed\n");
+		return -1;
+	}
+	ret = _favorites_bookmark_get_meta("urls_version", bookmark_version);
+	if (ret == 0 && _favorites_bookmark_get_meta("urls_changed", &bookmark_changes) < 0)
+		bookmark_changes = -1;
+	_favorites_close_bookmark_db();
+	if (ret < 0)
+		return -1;
+
+	if (_favorites_history_db_open() < 0) {
+		FAVORITES_LOGE("db_util_open is failed\n");
+		return -1;
+	}
+	ret = _favorites_history_get_meta("urls_version", history_version);
+	if (ret == 0 && _favorites_history_get_meta("urls_changed", &history_changes) < 0)
+		history_changes = -1;
+	_favorites_history_db_close();
+
+	*changes = bookmark_changes < 0 || history_changes < 0
+		? -1 : bookmark_changes + history_changes;
+	return ret;
+}
+
+/* Builds the filter from both dbs, called with gl_url_filter_lock held.
+ * The versions are read first, so that urls added during the scan are
+ * caught by the next check. Buffered visits are flushed first, and the
+ * ones a failed flush left in the buffer are set from there, so that no
+ * recorded visit is missing from the new filter. */
+static int _favorites_url_filter_build(void)
+{
+	url_hash_array_s array = { NULL, 0, 0 };
+	sqlite3_int64 bookmark_version;
+	sqlite3_int64 history_version;
+	sqlite3_int64 changes;
+	sqlite3_int64 bookmark_rowid = 0;
+	sqlite3_int64 history_rowid = 0;
+	unsigned long long nbits;
+	double log2_inverse;
+	int incremental = 0;
+	int capacity;
+	int i;
+	FAVORITES_TRACE_BEGIN(FAVORITES_TRACE_LEVEL_DEBUG, trace_start);
+
+	_favorites_history_flush_visits();
+	if (_favorites_url_filter_versions(&bookmark_version, &history_version, &changes) < 0)
+		return -1;
+
+	if (_favorites_url_filter_load(&bookmark_rowid, &history_rowid,
+			&incremental, &array) < 0) {
+		free(array.hash);
+		return -1;
+	}
+
+	/* m = n * log2(1/p) / ln 2 bits and k = log2(1/p) hashes */
+	capacity = array.count * 2;
+	if (capacity < URL_FILTER_MIN_CAPACITY)
+		capacity = URL_FILTER_MIN_CAPACITY;
+	log2_inverse = _favorites_url_filter_log2_inverse(gl_url_filter_rate);
+	nbits = (unsigned long long)(capacity * log2_inverse * 1.4427) + 64;
+
+	free(gl_url_filter_bits);
+	gl_url_filter_bits = (unsigned char *)calloc(nbits / 8 + 1, 1);
+	if (gl_url_filter_bits == NULL) {
+		FAVORITES_LOGE("out of memory\n");
+		free(array.hash);
+		return -1;
+	}
+	gl_url_filter_nbits = nbits;
+	gl_url_filter_hashes = (int)(log2_inverse + 0.5);
+	if (gl_url_filter_hashes < 1)
+		gl_url_filter_hashes = 1;
+	if (gl_url_filter_hashes > URL_FILTER_MAX_HASHES)
+		gl_url_filter_hashes = URL_FILTER_MAX_HASHES;
+	gl_url_filter_capacity = capacity;
+	gl_url_filter_count = array.count;
+	for (i = 0; i < array.count; i++)
+		_favorites_url_filter_bits(array.hash[i], 1);
+	free(array.hash);
+	_favorites_history_foreach_visit_hash(_favorites_url_filter_set_visit);
+
+	gl_url_filter_bookmark_version = bookmark_version;
+	gl_url_filter_history_version = history_version;
+	gl_url_filter_changes = changes;
+	gl_url_filter_bookmark_rowid = bookmark_rowid;
+	gl_url_filter_history_rowid = history_rowid;
+	gl_url_filter_incremental = incremental && changes >= 0;
+	gl_url_filter_checked = time(NULL);
+	FAVORITES_TRACE_END(trace_start, "url filter build", gl_url_filter_count);
+	FAVORITES_LOGD("url filter: %d urls, %llu bits, %d hashes\n",
+			gl_url_filter_count, gl_url_filter_nbits, gl_url_filter_hashes);
+	return 0;
+}
+
+/* Adds the urls other connections added since the last load, called with
+ * gl_url_filter_lock held */
+static int _favorites_url_filter_update(sqlite3_int64 bookmark_version,
+		sqlite3_int64 history_version)
+{
+	url_hash_array_s array = { NULL, 0, 0 };
+	sqlite3_int64 bookmark_rowid = gl_url_filter_bookmark_rowid;
+	sqlite3_int64 history_rowid = gl_url_filter_history_rowid;
+	int i;
+	FAVORITES_TRACE_BEGIN(FAVORITES_TRACE_LEVEL_DEBUG, trace_start);
+
+	if (_favorites_url_filter_load(&bookmark_rowid, &history_rowid, NULL, &array) < 0) {
+		free(array.hash);
+		return -1;
+	}
+	for (i = 0; i < array.count; i++)
+		_favorites_url_filter_bits(array.hash[i], 1);
+	gl_url_filter_count += array.count;
+	free(array.hash);
+
+	gl_url_filter_bookmark_version = bookmark_version;
+	gl_url_filter_history_version = history_version;
+	gl_url_filter_bookmark_rowid = bookmark_rowid;
+	gl_url_filter_history_rowid = history_rowid;
+	FAVORITES_TRACE_END(trace_start, "url filter update", array.count);
+	return 0;
+}
+
+/* Builds the filter, updates it when other connections added urls, or
+ * rebuilds it when it is full. Called with gl_url_filter_lock held. */
+static int _favorites_url_filter_check(void)
+{
+	sqlite3_int64 bookmark_version;
+	sqlite3_int64 history_version;
+	sqlite3_int64 changes;
+	time_t now = time(NULL);
+
+	if (gl_url_filter_bits == NULL || gl_url_filter_count > gl_url_filter_capacity)
+		return _favorites_url_filter_build();
+	if (now - gl_url_filter_checked < URL_FILTER_CHECK_INTERVAL
+			&& now >= gl_url_filter_checked)
+		return 0;
+
+	if (_favorites_url_filter_versions(&bookmark_version, &history_version, &changes) < 0)
+		return -1;
+	gl_url_filter_checked = now;
+	if (bookmark_version == gl_url_filter_bookmark_version
+			&& history_version == gl_url_filter_history_version)
+		return 0;
+	/* the versions are read before the rows, as in the build */
+	if (!gl_url_filter_incremental || changes != gl_url_filter_changes)
+		return _favorites_url_filter_build();
+	return _favorites_url_filter_update(bookmark_version, history_version);
+}
+
+/* A url was written through the library. It is counted when the next
+ * update loads its row. */
+void _favorites_url_filter_add(sqlite3_int64 url_hash)
+{
+	pthread_mutex_lock(&gl_url_filter_lock);
+	if (gl_url_filter_bits != NULL)
+		_favorites_url_filter_bits(url_hash, 1);
+	pthread_mutex_unlock(&gl_url_filter_lock);
+}
+
+/* The dbs were replaced, the filter is built again on next use */
+void _favorites_url_filter_invalidate(void)
+{
+	pthread_mutex_lock(&gl_url_filter_lock);
+	free(gl_url_filter_bits);
+	gl_url_filter_bits = NULL;
+	gl_url_filter_count = 0;
+	gl_url_filter_bookmark_rowid = 0;
+	gl_url_filter_history_rowid = 0;
+	pthread_mutex_unlock(&gl_url_filter_lock);
+}
+
+/* Whether the opened db has a row with this exact address */
+static int _favorites_url_filter_confirm(sqlite3 *db, const char *query,
+		const char *url, bool *found)
+{
+	sqlite3_stmt *stmt;
+	int nError;
+
+	if (sqlite3_prepare_v2(db, query, -1, &stmt, NULL) != SQLITE_OK) {
+		FAVORITES_LOGE("sqlite3_prepare_v2 is failed.\n");
+		sqlite3_finalize(stmt);
+		return -1;
+	}
+	sqlite3_bind_int64(stmt, 1, _favorites_db_url_hash(url));
+	sqlite3_bind_text(stmt, 2, url, -1, NULL);
+	nError = sqlite3_step(stmt);
+	sqlite3_finalize(stmt);
+	if (nError != SQLITE_ROW && nError != SQLITE_DONE) {
+		FAVORITES_LOGE("sqlite3_step is failed");
+		return -1;
+	}
+	*found = nError == SQLITE_ROW;
+	return 0;
+}
+
+/*************************************************************
+ *	APIs for Internet favorites
+ *************************************************************/
+int favorites_url_maybe_known(const char *url, bool *maybe_known)
+{
+	FAVORITES_API_ENTER();
+	FAVORITES_NULL_ARG_CHECK(maybe_known);
+	int ret;
+
+	if (!url || (strlen(url) <= 0)) {
+		FAVORITES_LOGE("url is empty\n");
+		return FAVORITES_ERROR_INVALID_PARAMETER;
+	}
+
+	pthread_mutex_lock(&gl_url_filter_lock);
+	ret = _favorites_url_filter_check();
+	/* a failed check keeps the last filter, if there is one */
+	if (gl_url_filter_bits != NULL) {
+		*maybe_known = _favorites_url_filter_bits(_favorites_db_url_hash(url), 0);
+		ret = 0;
+	}
+	pthread_mutex_unlock(&gl_url_filter_lock);
+	if (ret < 0)
+		return FAVORITES_ERROR_DB_FAILED;
+	return FAVORITES_ERROR_NONE;
+}
+
+int favorites_url_is_known(const char *url, bool *is_bookmarked, bool *is_visited)
+{
+	FAVORITES_API_ENTER();
+	bool found;
+
+	if (!url || (strlen(url) <= 0)) {
+		FAVORITES_LOGE("url is empty\n");
+		return FAVORITES_ERROR_INVALID_PARAMETER;
+	}
+
+	if (is_bookmarked != NULL) {
+		if (_favorites_open_bookmark_db() < 0) {
+			FAVORITES_LOGE("db_util_open is failed\n");
+			return FAVORITES_ERROR_DB_FAILED;
+		}
+		if (_favorites_url_filter_confirm(gl_internet_bookmark_db,
+				"select 1 from bookmarks where type=0\
+				and (url_hash=? or url_hash is null) and address=? limit 1",
+				url, &found) < 0) {
+			_favorites_close_bookmark_db();
+			return FAVORITES_ERROR_DB_FAILED;
+		}
+		_favorites_close_bookmark_db();
+		*is_bookmarked = found;
+	}
+
+	if (is_visited != NULL) {
+		_favorites_history_flush_visits();
+
+		if (_favorites_history_db_open() < 0) {
+			FAVORITES_LOGE("db_util_open is failed\n");
+			return FAVORITES_ERROR_DB_FAILED;
+		}
+		if (_favorites_url_filter_confirm(gl_internet_history_db,
+				"select 1 from history\
+				where (url_hash=? or url_hash is null) and address=? limit 1",
+				url, &found) < 0) {
+			_favorites_history_db_close();
+			return FAVORITES_ERROR_DB_FAILED;
+		}
+		_favorites_history_db_close();
+		*is_visited = found;
+	}
+	return FAVORITES_ERROR_NONE;
+}
+
+int favorites_url_set_false_positive_rate(double rate)
+{
+	FAVORITES_INVALID_ARG_CHECK(!(rate > 0 && rate < 1));
+
+	pthread_mutex_lock(&gl_url_filter_lock);
+	if (rate != gl_url_filter_rate) {
+		gl_url_filter_rate = rate;
+		/* resized on the next check */
+		free(gl_url_filter_bits);
+		gl_url_filter_bits = NULL;
+	}
+	pthread_mutex_unlock(&gl_url_filter_lock);
+	return FAVORITES_ERROR_NONE;
+}
@@ -0,0 +1,644 @@
+/*
+ * Copyright (c) 2011 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Concurrency stress harness. Forks processes which each run reader and
+ * writer threads on the bookmark and history databases for a while, then
+ * reports the throughput, the latency percentiles, the lock waits of
+ * favorites_db_foreach_lock_stats(), the timed phases of
+ * favorites_trace_foreach_event() and the violations found by
+ * favorites_db_check_integrity(), which also runs during the load.
+ *
+ * It writes into the databases of the device: run it on a test image.
+ * The exit status is 1 when a violation was found.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <favorites.h>
+
+#define STRESS_MAX_PROCESSES	64
+#define STRESS_MAX_THREADS	64
+#define STRESS_MAX_LATENCIES	(1 << 18)	/* samples per kind and process */
+#define STRESS_MAX_APIS		32
+#define STRESS_MAX_PHASES	32
+#define STRESS_NAME_SIZE	64
+#define STRESS_OWN_IDS		64	/* bookmarks a writer keeps to delete */
+#define STRESS_HOSTS		16
+
+enum {
+	STRESS_READ,
+	STRESS_WRITE,
+	STRESS_KINDS
+};
+
+struct stress_worker {
+	int process;
+	int thread;
+	unsigned int seed;
+	int serial;
+	int own_ids[STRESS_OWN_IDS];
+	int own_count;
+};
+typedef struct stress_worker stress_worker_s;
+
+struct stress_op {
+	const char *api;	/* matches the api of the lock stats */
+	int kind;
+	int (*run)(stress_worker_s *worker);
+};
+typedef struct stress_op stress_op_s;
+
+struct stress_lock {
+	char api[STRESS_NAME_SIZE];
+	long long busy_count;
+	long long retry_count;
+	long long failure_count;
+	long long wait_ms;
+	int max_wait_ms;
+};
+typedef struct stress_lock stress_lock_s;
+
+struct stress_phase {
+	char phase[STRESS_NAME_SIZE];
+	long long count;
+	long long total_us;
+	unsigned int max_us;
+};
+typedef struct stress_phase stress_phase_s;
+
+/* results of a process, in memory shared with the parent */
+struct stress_result {
+	long long calls[STRESS_MAX_APIS];
+	long long failures[STRESS_MAX_APIS];
+	int latency_count[STRESS_KINDS];
+	unsigned int latencies[STRESS_KINDS][STRESS_MAX_LATENCIES];	/* microseconds */
+	stress_lock_s locks[STRESS_MAX_APIS];
+	int lock_count;
+	stress_phase_s phases[STRESS_MAX_PHASES];
+	int phase_count;
+};
+typedef struct stress_result stress_result_s;
+
+static int gl_stress_processes = 2;
+static int gl_stress_threads = 4;
+static int gl_stress_write_percent = 20;
+static int gl_stress_seconds = 10;
+static int gl_stress_check_interval = 2;
+
+static volatile int gl_stress_stop = 0;
+static stress_result_s *gl_stress_result;
+static pthread_mutex_t gl_stress_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned long long _stress_now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*************************************************************
+ *	Operations
+ *************************************************************/
+static bool _stress_bookmark_cb(favorites_bookmark_entry_s *item, void *user_data)
+{
+	return true;
+}
+
+static bool _stress_summary_cb(favorites_bookmark_folder_summary_s *summary, void *user_data)
+{
+	return true;
+}
+
+static bool _stress_host_cb(favorites_history_host_s *item, void *user_data)
+{
+	return true;
+}
+
+static void _stress_url(stress_worker_s *worker, char *url, int size)
+{
+	snprintf(url, size, "http://stress%d.example/%d/%d/%d",
+			rand_r(&worker->seed) % STRESS_HOSTS, worker->process, worker->thread,
+			rand_r(&worker->seed) % 1024);
+}
+
+static int _stress_get_count(stress_worker_s *worker)
+{
+	int count;
+
+	return favorites_bookmark_get_count(&count);
+}
+
+static int _stress_foreach(stress_worker_s *worker)
+{
+	return favorites_bookmark_foreach(_stress_bookmark_cb, NULL);
+}
+
+static int _stress_folder_summary(stress_worker_s *worker)
+{
+	return favorites_bookmark_foreach_folder_summary(_stress_summary_cb, NULL);
+}
+
+static int _stress_foreach_host(stress_worker_s *worker)
+{
+	return favorites_history_foreach_host(FAVORITES_HISTORY_HOST_ORDER_MOST_VISITED, 10,
+			_stress_host_cb, NULL);
+}
+
+static int _stress_is_known(stress_worker_s *worker)
+{
+	char url[256];
+	bool is_bookmarked;
+	bool is_visited;
+
+	_stress_url(worker, url, sizeof(url));
+	return favorites_url_is_known(url, &is_bookmarked, &is_visited);
+}
+
+static int _stress_add_bookmark(stress_worker_s *worker)
+{
+	char url[256];
+	char folder[32];
+	int id;
+	int ret;
+
+	snprintf(url, sizeof(url), "http://stress.example/%d/%d/%d",
+			worker->process, worker->thread, worker->serial++);
+	snprintf(folder, sizeof(folder), "stress %d", rand_r(&worker->seed) % 4);
+	ret = favorites_bookmark_add_bookmark(url, "stress", folder, &id);
+	if (ret == FAVORITES_ERROR_NONE) {
+		worker->own_ids[worker->own_count % STRESS_OWN_IDS] = id;
+		worker->own_count++;
+	}
+	return ret;
+}
+
+static int _stress_delete_bookmark(stress_worker_s *worker)
+{
+	int slot;
+
+	if (worker->own_count == 0)
+		return _stress_add_bookmark(worker);
+	worker->own_count--;
+	slot = worker->own_count % STRESS_OWN_IDS;
+	return favorites_bookmark_delete_bookmark(worker->own_ids[slot]);
+}
+
+static int _stress_record_visit(stress_worker_s *worker)
+{
+	char url[256];
+
+	_stress_url(worker, url, sizeof(url));
+	return favorites_history_record_visit(url, "stress");
+}
+
+static int _stress_delete_history(stress_worker_s *worker)
+{
+	char url[256];
+
+	_stress_url(worker, url, sizeof(url));
+	return favorites_history_delete_history_by_url(url);
+}
+
+static const stress_op_s gl_stress_ops[] = {
+	{ "favorites_bookmark_get_count", STRESS_READ, _stress_get_count },
+	{ "favorites_bookmark_foreach", STRESS_READ, _stress_foreach },
+	{ "favorites_bookmark_foreach_folder_summary", STRESS_READ, _stress_folder_summary },
+	{ "favorites_history_foreach_host", STRESS_READ, _stress_foreach_host },
+	{ "favorites_url_is_known", STRESS_READ, _stress_is_known },
+	{ "favorites_bookmark_add_bookmark", STRESS_WRITE, _stress_add_bookmark },
+	{ "favorites_bookmark_delete_bookmark", STRESS_WRITE, _stress_delete_bookmark },
+	{ "favorites_history_record_visit", STRESS_WRITE, _stress_record_visit },
+	{ "favorites_history_delete_history_by_url", STRESS_WRITE, _stress_delete_history },
+	{ "favorites_history_flush", STRESS_WRITE, NULL },	/* at the end of each writer */
+};
+#define STRESS_OP_COUNT	((int)(sizeof(gl_stress_ops) / sizeof(gl_stress_ops[0])))
+#define STRESS_OP_FLUSH	(STRESS_OP_COUNT - 1)
+
+/* Picks an operation of the kind, uniformly */
+static int _stress_pick(stress_worker_s *worker, int kind)
+{
+	int candidates[STRESS_OP_COUNT];
+	int count = 0;
+	int i;
+
+	for (i = 0; i < STRESS_OP_COUNT; i++) {
+		if (gl_stress_ops[i].kind == kind && gl_stress_ops[i].run != NULL)
+			candidates[count++] = i;
+	}
+	return candidates[rand_r(&worker->seed) % count];
+}
+
+/*************************************************************
+ *	Workers
+ *************************************************************/
+static void _stress_account(int op, int ret, unsigned long long start)
+{
+	int kind = gl_stress_ops[op].kind;
+	int *count;
+
+	pthread_mutex_lock(&gl_stress_lock);
+	gl_stress_result->calls[op]++;
+	if (ret != FAVORITES_ERROR_NONE)
+		gl_stress_result->failures[op]++;
+	count = &gl_stress_result->latency_count[kind];
+	if (*count < STRESS_MAX_LATENCIES)
+		gl_stress_result->latencies[kind][(*count)++] = _stress_now_us() - start;
+	pthread_mutex_unlock(&gl_stress_lock);
+}
+
+/* Sums the events of the calling thread, before its ring is dropped */
+static bool _stress_trace_cb(const favorites_trace_event_s *event, void *user_data)
+{
+	stress_phase_s *phase = NULL;
+	int i;
+
+	if (event->thread_id != (unsigned long)pthread_self())
+		return true;
+	for (i = 0; i < gl_stress_result->phase_count; i++) {
+		if (!strcmp(gl_stress_result->phases[i].phase, event->phase)) {
+			phase = &gl_stress_result->phases[i];
+			break;
+		}
+	}
+	if (phase == NULL) {
+		if (gl_stress_result->phase_count == STRESS_MAX_PHASES)
+			return true;
+		phase = &gl_stress_result->phases[gl_stress_result->phase_count++];
+		snprintf(phase->phase, sizeof(phase->phase), "%s", event->phase);
+	}
+	phase->count++;
+	phase->total_us += event->duration_us;
+	if (event->duration_us > phase->max_us)
+		phase->max_us = event->duration_us;
+	return true;
+}
+
+static void *_stress_worker(void *data)
+{
+	stress_worker_s *worker = (stress_worker_s *)data;
+	unsigned long long start;
+	int op;
+	int ret;
+
+	while (!gl_stress_stop) {
+		if ((int)(rand_r(&worker->seed) % 100) < gl_stress_write_percent)
+			op = _stress_pick(worker, STRESS_WRITE);
+		else
+			op = _stress_pick(worker, STRESS_READ);
+		start = _stress_now_us();
+		ret = gl_stress_ops[op].run(worker);
+		_stress_account(op, ret, start);
+	}
+	start = _stress_now_us();
+	ret = favorites_history_flush();
+	_stress_account(STRESS_OP_FLUSH, ret, start);
+
+	pthread_mutex_lock(&gl_stress_lock);
+	favorites_trace_foreach_event(_stress_trace_cb, NULL);
+	pthread_mutex_unlock(&gl_stress_lock);
+	return NULL;
+}
+
+static bool _stress_lock_cb(const favorites_db_lock_stats_s *stats, void *user_data)
+{
+	stress_lock_s *lock;
+
+	if (gl_stress_result->lock_count == STRESS_MAX_APIS)
+		return false;
+	lock = &gl_stress_result->locks[gl_stress_result->lock_count++];
+	snprintf(lock->api, sizeof(lock->api), "%s", stats->api);
+	lock->busy_count = stats->busy_count;
+	lock->retry_count = stats->retry_count;
+	lock->failure_count = stats->failure_count;
+	lock->wait_ms = stats->wait_ms;
+	lock->max_wait_ms = stats->max_wait_ms;
+	return true;
+}
+
+static void _stress_process(int process)
+{
+	pthread_t threads[STRESS_MAX_THREADS];
+	stress_worker_s workers[STRESS_MAX_THREADS];
+	int i;
+
+	favorites_trace_set_level(FAVORITES_TRACE_LEVEL_INFO);
+	for (i = 0; i < gl_stress_threads; i++) {
+		memset(&workers[i], 0, sizeof(stress_worker_s));
+		workers[i].process = process;
+		workers[i].thread = i;
+		workers[i].seed = (unsigned int)(getpid() * 131 + i);
+		if (pthread_create(&threads[i], NULL, _stress_worker, &workers[i]) != 0) {
+			fprintf(stderr, "pthread_create is failed\n");
+			_exit(2);
+		}
+	}
+	sleep(gl_stress_seconds);
+	gl_stress_stop = 1;
+	for (i = 0; i < gl_stress_threads; i++)
+		pthread_join(threads[i], NULL);
+	favorites_db_foreach_lock_stats(_stress_lock_cb, NULL);
+}
+
+/*************************************************************
+ *	Report
+ *************************************************************/
+static int _stress_compare(const void *a, const void *b)
+{
+	unsigned int x = *(const unsigned int *)a;
+	unsigned int y = *(const unsigned int *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static unsigned int _stress_percentile(const unsigned int *sorted, int count, int per_mille)
+{
+	if (count == 0)
+		return 0;
+	return sorted[(int)((long long)(count - 1) * per_mille / 1000)];
+}
+
+static void _stress_report_latencies(stress_result_s *results, int processes)
+{
+	static const char *kinds[STRESS_KINDS] = { "read", "write" };
+	unsigned int *all;
+	int kind;
+	int count;
+	int p;
+
+	all = (unsigned int *)malloc(sizeof(unsigned int) * STRESS_MAX_LATENCIES * processes);
+	if (all == NULL)
+		return;
+	printf("\n%-6s %10s %10s %10s %10s %10s (us)\n", "kind", "samples", "p50", "p99",
+			"p99.9", "max");
+	for (kind = 0; kind < STRESS_KINDS; kind++) {
+		count = 0;
+		for (p = 0; p < processes; p++) {
+			memcpy(all + count, results[p].latencies[kind],
+					sizeof(unsigned int) * results[p].latency_count[kind]);
+			count += results[p].latency_count[kind];
+		}
+		qsort(all, count, sizeof(unsigned int), _stress_compare);
+		printf("%-6s %10d %10u %10u %10u %10u\n", kinds[kind], count,
+				_stress_percentile(all, count, 500), _stress_percentile(all, count, 990),
+				_stress_percentile(all, count, 999), count ? all[count - 1] : 0);
+	}
+	free(all);
+}
+
+static void _stress_report_locks(stress_result_s *results, int processes,
+		const long long *calls)
+{
+	stress_lock_s locks[STRESS_MAX_APIS];
+	int lock_count = 0;
+	int p, i, j, op;
+
+	memset(locks, 0, sizeof(locks));
+	for (p = 0; p < processes; p++) {
+		for (i = 0; i < results[p].lock_count; i++) {
+			for (j = 0; j < lock_count; j++) {
+				if (!strcmp(locks[j].api, results[p].locks[i].api))
+					break;
+			}
+			if (j == lock_count) {
+				if (lock_count == STRESS_MAX_APIS)
+					continue;
+				memcpy(locks[lock_count].api, results[p].locks[i].api, STRESS_NAME_SIZE);
+				lock_count++;
+			}
+			locks[j].busy_count += results[p].locks[i].busy_count;
+			locks[j].retry_count += results[p].locks[i].retry_count;
+			locks[j].failure_count += results[p].locks[i].failure_count;
+			locks[j].wait_ms += results[p].locks[i].wait_ms;
+			if (results[p].locks[i].max_wait_ms > locks[j].max_wait_ms)
+				locks[j].max_wait_ms = results[p].locks[i].max_wait_ms;
+		}
+	}
+
+	printf("\n%-42s %8s %8s %8s %8s %10s %8s\n", "lock waits", "busy", "busy/op",
+			"retries", "failures", "wait ms", "max ms");
+	for (j = 0; j < lock_count; j++) {
+		long long api_calls = 0;
+
+		for (op = 0; op < STRESS_OP_COUNT; op++) {
+			if (!strcmp(gl_stress_ops[op].api, locks[j].api))
+				api_calls = calls[op];
+		}
+		printf("%-42s %8lld %7.2f%% %8lld %8lld %10lld %8d\n", locks[j].api,
+				locks[j].busy_count,
+				api_calls ? 100.0 * locks[j].busy_count / api_calls : 0.0,
+				locks[j].retry_count, locks[j].failure_count, locks[j].wait_ms,
+				locks[j].max_wait_ms);
+	}
+	if (lock_count == 0)
+		printf("none\n");
+}
+
+static void _stress_report_phases(stress_result_s *results, int processes)
+{
+	stress_phase_s phases[STRESS_MAX_PHASES];
+	int phase_count = 0;
+	int p, i, j;
+
+	memset(phases, 0, sizeof(phases));
+	for (p = 0; p < processes; p++) {
+		for (i = 0; i < results[p].phase_count; i++) {
+			for (j = 0; j < phase_count; j++) {
+				if (!strcmp(phases[j].phase, results[p].phases[i].phase))
+					break;
+			}
+			if (j == phase_count) {
+				if (phase_count == STRESS_MAX_PHASES)
+					continue;
+				memcpy(phases[phase_count].phase, results[p].phases[i].phase,
+						STRESS_NAME_SIZE);
+				phase_count++;
+			}
+			phases[j].count += results[p].phases[i].count;
+			phases[j].total_us += results[p].phases[i].total_us;
+			if (results[p].phases[i].max_us > phases[j].max_us)
+				phases[j].max_us = results[p].phases[i].max_us;
+		}
+	}
+
+	/* the rings keep the latest events of each thread only */
+	printf("\n%-42s %8s %10s %10s (us, latest events)\n", "trace phase", "events",
+			"mean", "max");
+	for (j = 0; j < phase_count; j++) {
+		printf("%-42s %8lld %10lld %10u\n", phases[j].phase, phases[j].count,
+				phases[j].total_us / phases[j].count, phases[j].max_us);
+	}
+}
+
+/*************************************************************
+ *	Integrity checks
+ *************************************************************/
+static int gl_stress_checks = 0;
+static int gl_stress_check_failures = 0;
+static int gl_stress_violations = 0;
+
+static void _stress_check(void)
+{
+	int violations = 0;
+
+	if (favorites_db_check_integrity(&violations) != FAVORITES_ERROR_NONE) {
+		gl_stress_check_failures++;
+		return;
+	}
+	gl_stress_checks++;
+	gl_stress_violations += violations;
+}
+
+static void *_stress_checker(void *data)
+{
+	while (!gl_stress_stop) {
+		sleep(gl_stress_check_interval);
+		if (!gl_stress_stop)
+			_stress_check();
+	}
+	return NULL;
+}
+
+/*************************************************************
+ *	Main
+ *************************************************************/
+static void _stress_usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-p processes] [-t threads] [-w write percent]"
+			" [-d seconds] [-i check interval]\n", name);
+}
+
+static int _stress_option(const char *arg, int min, int max, int *value)
+{
+	char *end;
+	long number = strtol(arg, &end, 10);
+
+	if (*arg == '\0' || *end != '\0' || number < min || number > max)
+		return -1;
+	*value = (int)number;
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	stress_result_s *results;
+	pthread_t checker;
+	pid_t pids[STRESS_MAX_PROCESSES];
+	long long calls[STRESS_MAX_APIS];
+	long long failures = 0;
+	long long total = 0;
+	size_t size;
+	int status;
+	int opt;
+	int p, op;
+
+	while ((opt = getopt(argc, argv, "p:t:w:d:i:")) != -1) {
+		int ret;
+
+		switch (opt) {
+		case 'p':
+			ret = _stress_option(optarg, 1, STRESS_MAX_PROCESSES, &gl_stress_processes);
+			break;
+		case 't':
+			ret = _stress_option(optarg, 1, STRESS_MAX_THREADS, &gl_stress_threads);
+			break;
+		case 'w':
+			ret = _stress_option(optarg, 0, 100, &gl_stress_write_percent);
+			break;
+		case 'd':
+			ret = _stress_option(optarg, 1, 86400, &gl_stress_seconds);
+			break;
+		case 'i':
+			ret = _stress_option(optarg, 1, 3600, &gl_stress_check_interval);
+			break;
+		default:
+			ret = -1;
+			break;
+		}
+		if (ret < 0) {
+			_stress_usage(argv[0]);
+			return 2;
+		}
+	}
+
+	size = sizeof(stress_result_s) * gl_stress_processes;
+	results = (stress_result_s *)mmap(NULL, size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (results == MAP_FAILED) {
+		fprintf(stderr, "mmap is failed\n");
+		return 2;
+	}
+
+	printf("%d processes x %d threads, %d%% writes, %d s\n", gl_stress_processes,
+			gl_stress_threads, gl_stress_write_percent, gl_stress_seconds);
+	/* the parent only checks, so the children do not inherit its state */
+	for (p = 0; p < gl_stress_processes; p++) {
+		pids[p] = fork();
+		if (pids[p] < 0) {
+			fprintf(stderr, "fork is failed\n");
+			gl_stress_processes = p;
+			break;
+		}
+		if (pids[p] == 0) {
+			gl_stress_result = &results[p];
+			_stress_process(p);
+			_exit(0);
+		}
+	}
+	pthread_create(&checker, NULL, _stress_checker, NULL);
+	for (p = 0; p < gl_stress_processes; p++) {
+		waitpid(pids[p], &status, 0);
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			fprintf(stderr, "process %d failed\n", p);
+	}
+	gl_stress_stop = 1;
+	pthread_join(checker, NULL);
+	/* and once more on the quiet databases */
+	_stress_check();
+
+	memset(calls, 0, sizeof(calls));
+	printf("\n%-42s %10s %10s %10s\n", "api", "calls", "calls/s", "failures");
+	for (op = 0; op < STRESS_OP_COUNT; op++) {
+		long long op_failures = 0;
+
+		for (p = 0; p < gl_stress_processes; p++) {
+			calls[op] += results[p].calls[op];
+			op_failures += results[p].failures[op];
+		}
+		total += calls[op];
+		failures += op_failures;
+		printf("%-42s %10lld %10.1f %10lld\n", gl_stress_ops[op].api, calls[op],
+				(double)calls[op] / gl_stress_seconds, op_failures);
+	}
+	printf("%-42s %10lld %10.1f %10lld\n", "total", total,
+			(double)total / gl_stress_seconds, failures);
+
+	_stress_report_latencies(results, gl_stress_processes);
+	_stress_report_locks(results, gl_stress_processes, calls);
+	_stress_report_phases(results, gl_stress_processes);
+
+	printf("\nintegrity: %d checks, %d violations, %d failed checks\n", gl_stress_checks,
+			gl_stress_violations, gl_stress_check_failures);
+	munmap(results, size);
+	return gl_stress_violations > 0 ? 1 : 0;
+}